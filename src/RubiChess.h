@@ -53,6 +53,19 @@
 // Enable this to enable NNUE debug output
 //#define NNUEDEBUG
 
+// Enable this for a lock-free transposition table that detects and rejects torn entries
+// (recommended for very high thread counts)
+//#define TTLOCKFREE
+
+// Enable this to select another geometry of the transposition table cluster (TTLayout3x10, TTLayout6x10, TTLayout5x12)
+//#define TTLAYOUT TTLayout6x10
+
+// Enable this to save and restore the board as a whole in playMove/unplayMove (copy-make) instead of undoing the move
+//#define COPYMAKE
+
+// Enable this to cache the attackers of the target squares for all SEE calls of a node
+//#define SEECACHE
+
 // Enable this to compile support for asserts including stack trace
 // MSVC only, link with DbgHelp.lib
 //#define STACKDEBUG
@@ -83,6 +96,10 @@
 #include <algorithm>
 #include <iterator>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <time.h>
 #include <array>
@@ -384,7 +401,7 @@ enum Color { WHITE, BLACK };
 
 
 // Forward definitions
-class transposition;
+template <class L> class transpositiontable;
 class chessposition;
 class searchthread;
 struct pawnhashentry;
@@ -777,7 +794,8 @@ string IndexToAlgebraic(int i);
 void BitboardDraw(U64 b);
 U64 getTime();
 string CurrentWorkingDir();
-#ifdef _WIN32
+#if defined(_WIN32) || (defined(__linux__) && !defined(__ANDROID__))
+#define LARGEPAGESUPPORT
 void* my_large_malloc(size_t s);
 void my_large_free(void *m);
 #else
@@ -802,6 +820,7 @@ enum NnueType { NnueDisabled = 0, NnueArchV1, NnueArchV5 };
 #define NNUEFILEVERSIONSFNNv5_1024  0x7af32f20u
 #define NNUEFILEVERSIONSFNNv5_512   0x7af32f30u
 #define NNUEFILEVERSIONSFNNv5_768   0x7af32f31u
+#define NNUEFILEVERSIONSFNNv5_I8    0x7af32f40u    // V5 with 8bit feature weights, written by 'export <file> i8'
 #define NNUENETLAYERHASH            0xCC03DAE4u
 #define NNUECLIPPEDRELUHASH         0x538D24C7u
 #define NNUEFEATUREHASH_HalfKP      0x5D69D5B8u
@@ -811,6 +830,21 @@ enum NnueType { NnueDisabled = 0, NnueArchV1, NnueArchV5 };
 #define ORIENT(c,i) ((c) ? (i) ^ 0x3f : (i))
 #define HMORIENT(c,i,k) (i ^ (bool(c) * 56) ^ ((FILE(k) < 4) * 7))
 #define MULTIPLEOFN(i,n) (((i) + (n - 1)) / n * n)
+#define NNUEBATCHCHUNK 64      // positions of a batch sorted by layer stack before propagating them
+
+// Shared network format: the weights in the memory layout of the build (shuffled, aligned) behind a page sized header
+// so the file can be mapped read-only and shared by all engine processes on the host
+#define NNUESHAREDMAGIC         0x53454e52u     // "RNES"
+#define NNUESHAREDHEADERSIZE    0x1000
+struct nnuesharedheader {
+    uint32_t magic;
+    uint32_t version;       // file version of the architecture
+    uint32_t ftdims;        // output dimensions of the feature transformer
+    uint32_t filehash;      // hash of the architecture as in the original network file
+    uint32_t layouthash;    // hash of the weight layout of the build
+    uint32_t reserved;
+    U64 weightssize;
+};
 
 #if defined(USE_SSE2) && !defined(USE_SSSE3) && defined FASTSSE2
 // for native SSE2 platforms we have faster intrinsics for 16bit integers
@@ -836,16 +870,27 @@ typedef struct {
 } DirtyPiece;
 
 
+class NnueArchitecture;
+void NnueFreeArch(NnueArchitecture* arch);
+
 class NnueNetsource {
 public:
     ~NnueNetsource() {
-        if (readbuffer)
+        if (readbuffer && ownbuffer)
             freealigned64(readbuffer);
         readbuffer = nullptr;
+        NnueFreeArch(arch);
     };
+    NnueArchitecture* arch = nullptr;   // the network read by open(); NnueSwap takes it over
+    NnueType nt = NnueDisabled;
     unsigned char* readbuffer;
     size_t readbuffersize;
     unsigned char* next;
+    bool ownbuffer = true;      // false if readbuffer points to the embedded network or a buffer owned by open()
+    U64 featuretime = 0;        // time stamps for the load statistics
+    U64 layertime = 0;
+    int leb128threads = 0;      // threads used for decoding the LEB128 compressed feature transformer
+    string netpath;             // network to open; empty for the NNUENetpath option
     bool open();
     bool read(unsigned char* target, size_t readsize);
     bool write(unsigned char* source, size_t writesize);
@@ -853,12 +898,22 @@ public:
 };
 
 
+// Timing of one NNUE kernel in 'bench nnue'
+struct NnueKernelTiming {
+    string kernel;
+    string variant;
+    U64 calls;
+    U64 time;       // in nanoseconds (steady_clock)
+    U64 bytes;      // weights, accumulators, inputs and outputs read or written by all calls
+};
+
 class NnueArchitecture
 {
 public:
     virtual bool ReadFeatureWeights(NnueNetsource* nr, bool bpz) = 0;
     virtual bool ReadWeights(NnueNetsource* nr, uint32_t nethash) = 0;
     virtual void WriteFeatureWeights(NnueNetsource* nr, bool bpz) = 0;
+    virtual size_t WriteFeatureWeightsInt8(NnueNetsource* nr, bool leb128) = 0;
     virtual void WriteWeights(NnueNetsource* nr, uint32_t nethash) = 0;
     virtual void RescaleLastLayer(int ratio64) = 0;
     virtual string GetArchName() = 0;
@@ -867,7 +922,10 @@ public:
     virtual uint32_t GetHash() = 0;
     virtual int GetEval(chessposition* pos) = 0;
     virtual void SpeculativeEval(chessposition* pos) = 0;
-    virtual int16_t* GetFeatureWeight() = 0;
+    virtual size_t GetBatchEntrySize() = 0;
+    virtual void BatchTransform(chessposition* pos, unsigned char* entry) = 0;
+    virtual void BatchPropagate(unsigned char* entries, int n, int* evals) = 0;
+    virtual void* GetFeatureWeight() = 0;
     virtual int16_t* GetFeatureBias() = 0;
     virtual int32_t* GetFeaturePsqtWeight() = 0;
     virtual uint32_t GetFileVersion() = 0;
@@ -878,10 +936,18 @@ public:
     virtual unsigned int GetAccumulationSize() = 0;
     virtual unsigned int GetPsqtAccumulationSize() = 0;
     virtual size_t GetNetworkFilesize() = 0;
+    virtual void BenchKernels(chessposition* pos, vector<string>* fens, vector<NnueKernelTiming>* timings) = 0;
+    virtual size_t GetWeightsSize() = 0;
+    virtual void SetWeights(unsigned char* w) = 0;
+    virtual uint32_t GetLayoutHash() = 0;
 #ifdef STATISTICS
     virtual void SwapInputNeurons(unsigned int i1, unsigned int i2) = 0;
     virtual void Statistics(bool verbose, bool sort) = 0;
 #endif
+    unsigned char* weights = nullptr;   // memory block with the weights of all layers
+    size_t mappedsize = 0;              // > 0 for weights mapped read-only from a shared network file
+    bool AllocWeights();
+    void FreeWeights();
 };
 
 
@@ -889,6 +955,55 @@ extern NnueType NnueReady;
 extern NnueArchitecture* NnueCurrentArch;
 
 
+// Evaluation of many independent positions: add() runs the feature transformer of each position
+// into its own input slot, evaluate() runs the network layers over the batch grouped by layer stack;
+// add() refuses positions when the batch is full, so the caller has to evaluate and clear it first
+class NnueBatch
+{
+    unsigned char* entries;
+    size_t entrysize;
+    int capacity;
+public:
+    int size;
+    NnueBatch(int n);
+    ~NnueBatch();
+    bool add(chessposition* pos);   // false if the batch is full
+    void evaluate(int* evals) { evaluate(evals, 0, size); }
+    void evaluate(int* evals, int first, int num);
+    void clear() { size = 0; }
+};
+
+
+// Cache of the NNUE evaluation shared by all threads and keyed by the position hash
+// An entry packs the upper 48 bits of the hash and the 16bit evaluation into one word that is read and written
+// atomically, so a concurrent write can never hand out the evaluation of another position
+class NnueEvalCache
+{
+    atomic<U64>* table = nullptr;
+    U64 sizemask = 0;
+public:
+    void setSize(int sizeMb);
+    void remove();
+    void clean();
+    bool active() { return table != nullptr; }
+    bool probe(U64 hash, int* value) {
+        U64 e = table[hash & sizemask].load(memory_order_relaxed);
+        if ((e ^ hash) >> 16)
+            return false;
+        *value = (int16_t)(e & 0xffff);
+        return true;
+    }
+    void store(U64 hash, int value) {
+        if (value >= INT16_MIN && value <= INT16_MAX)
+            table[hash & sizemask].store((hash & ~0xffffULL) | (uint16_t)value, memory_order_relaxed);
+    }
+};
+
+extern NnueEvalCache nnuecache;
+
+bool playRandomLegalMove(chessposition* pos, ranctx* rnd);
+
+
 class NnueLayer
 {
 public:
@@ -906,21 +1021,32 @@ public:
 };
 
 
-template <int ftdims, int inputdims, int psqtbuckets>
+template <int ftdims, int inputdims, int psqtbuckets, typename ftweight_t = int16_t>
 class NnueFeatureTransformer : public NnueLayer
 {
 public:
-    alignas(64) int16_t bias[ftdims];
-    alignas(64) int16_t weight[ftdims * inputdims];
-    alignas(64) int32_t psqtWeights[psqtbuckets ? psqtbuckets * inputdims : 1];    // hack to avoid zero-sized array
+    static constexpr size_t biasSize = MULTIPLEOFN(ftdims * sizeof(int16_t), 64);
+    static constexpr size_t weightSize = MULTIPLEOFN((size_t)ftdims * inputdims * sizeof(ftweight_t), 64);
+    static constexpr size_t psqtWeightSize = MULTIPLEOFN((size_t)psqtbuckets * inputdims * sizeof(int32_t), 64);
+    static constexpr size_t WeightsSize = biasSize + weightSize + psqtWeightSize;
+    int16_t* bias;
+    ftweight_t* weight;
+    int32_t* psqtWeights;
 
     NnueFeatureTransformer() : NnueLayer(NULL) {}
+    unsigned char* SetWeights(unsigned char* w) {
+        bias = (int16_t*)w;
+        weight = (ftweight_t*)(w + biasSize);
+        psqtWeights = (int32_t*)(w + biasSize + weightSize);
+        return w + WeightsSize;
+    }
     bool ReadFeatureWeights(NnueNetsource* nr, bool bpz);
     bool ReadWeights(NnueNetsource* nr) {
         if (previous) return previous->ReadWeights(nr);
         return true;
     }
     void WriteFeatureWeights(NnueNetsource* nr, bool bpz);
+    size_t WriteFeatureWeightsInt8(NnueNetsource* nr, bool leb128);
     void WriteWeights(NnueNetsource* nr) {
         if (previous)
             previous->WriteWeights(nr);
@@ -942,7 +1068,7 @@ public:
         for (unsigned int i = 0; i < inputdims; i++)
         {
             int offset = i * ftdims;
-            int16_t weight_temp = weight[offset + i1];
+            ftweight_t weight_temp = weight[offset + i1];
             weight[offset + i1] = weight[offset + i2];
             weight[offset + i2] = weight_temp;
         }
@@ -1020,7 +1146,6 @@ class NnueNetworkLayer : public NnueLayer
 #if defined(USE_SSSE3) || defined(USE_ARM64)
 #define USE_PROPAGATESPARSE
     static constexpr bool useSparsePropagation = (paddedInputdims >= 512);
-    void PropagateSparse(clipped_t* input, int32_t* output);
 #else
     static constexpr bool useSparsePropagation = false;
 #endif
@@ -1045,8 +1170,10 @@ class NnueNetworkLayer : public NnueLayer
 #endif
 
 public:
-    alignas(64)int32_t bias[outputdims];
-    alignas(64)weight_t weight[paddedInputdims * outputdims];
+    static constexpr size_t biasSize = MULTIPLEOFN(outputdims * sizeof(int32_t), 64);
+    static constexpr size_t WeightsSize = biasSize + MULTIPLEOFN(paddedInputdims * outputdims * sizeof(weight_t), 64);
+    int32_t* bias;
+    weight_t* weight;
 #ifdef STATISTICS
     U64 nonzeroevals[paddedInputdims] = { 0 };
     U64 total_evals = 0;
@@ -1063,6 +1190,18 @@ public:
 #endif
 
     NnueNetworkLayer(NnueLayer* prev) : NnueLayer(prev) {}
+    unsigned char* SetWeights(unsigned char* w) {
+        bias = (int32_t*)w;
+        weight = (weight_t*)(w + biasSize);
+        return w + WeightsSize;
+    }
+    uint32_t GetLayoutHash() {
+        // the shuffling of the weights depends on the SIMD width of the build
+        uint32_t h = (paddedInputdims << 16) ^ (outputdims << 4) ^ (uint32_t)sizeof(weight_t);
+        for (unsigned int i = 0; i < paddedInputdims * outputdims; i++)
+            h = (h ^ shuffleWeightIndex(i)) * 0x01000193u;
+        return h;
+    }
     bool ReadWeights(NnueNetsource* nr);
     bool OverflowPossible();
     void WriteWeights(NnueNetsource* nr);
@@ -1073,6 +1212,13 @@ public:
     void PropagateBigLayer(clipped_t* input, int32_t* output);
     void PropagateSmallLayer(clipped_t* input, int32_t* output);
     void PropagateNative(clipped_t* input, int32_t* output);
+#ifdef USE_PROPAGATESPARSE
+    void PropagateSparse(clipped_t* input, int32_t* output);
+#endif
+    static const char* GetPropagateVariant() {
+        // the variant that Propagate uses for this layer in this build
+        return useSparsePropagation ? "Sparse" : useSmallLayerPropagation ? "Small" : useBigLayerPropagation ? "Big" : "Native";
+    }
     inline unsigned int shuffleWeightIndex(unsigned int idx)
     {
         if (useBigLayerPropagation)
@@ -1100,6 +1246,7 @@ public:
 
 void NnueInit();
 void NnueRemove();
+void NnueSwap(NnueArchitecture* arch, NnueType nt);
 bool NnueReadNet(NnueNetsource* nr);
 void NnueWriteNet(vector<string> args);
 #ifdef EVALOPTIONS
@@ -1155,6 +1302,9 @@ void learn(vector<string> args);
 #define AGEMASK         ((0xff << AGESHIFT) & 0xff)
 #define AGECYCLE        (255 + AGEINC)
 #define TTDEPTH_OFFSET  -1  // we don't save negative depth to tt so -1 should be okay to detect free entries by testing depth == 0
+#define TTSTATSAMPLES   4096    // number of clusters sampled for the tt statistics
+
+#define ZOBRISTSEED     0
 
 class zobrist
 {
@@ -1171,23 +1321,50 @@ public:
     U64 getMaterialHash(chessposition *pos);
 };
 
-#define TTBUCKETNUM 3
+// Geometry of the transposition table cluster: type of the key, number of entries and bytes
+template <typename H, int N, int B> struct ttlayout {
+    typedef H hashupper_t;
+    static const int buckets = N;
+    static const int bytes = B;
+};
 
-typedef uint16_t hashupper_t;
-#define GETHASHUPPER(x) (hashupper_t)((x) >> (64 - sizeof(hashupper_t) * 8))
+typedef ttlayout<uint16_t, 3, 32> TTLayout3x10;     // 3 entries with 16bit key in 32 bytes (default)
+typedef ttlayout<uint16_t, 6, 64> TTLayout6x10;     // 6 entries with 16bit key in a cache line
+typedef ttlayout<uint32_t, 5, 64> TTLayout5x12;     // 5 entries with 32bit key in a cache line
 
-struct ttentry {
-    hashupper_t hashupper;
+#ifndef TTLAYOUT
+#define TTLAYOUT TTLayout3x10
+#endif
+
+template <typename H> struct ttentryT {
+    H hashupper;
     uint16_t movecode;
     int16_t value;
     int16_t staticeval;
     uint8_t depth;
     uint8_t boundAndAge;
+#ifdef TTLOCKFREE
+    uint8_t bucket;     // slot in the cluster this snapshot was read from and will be written to
+    void* cluster;
+#endif
 };
 
-struct transpositioncluster {
-    ttentry entry[TTBUCKETNUM];
-    uint8_t padding[(64 - sizeof(ttentry) * TTBUCKETNUM) % 16];
+#ifdef TTLOCKFREE
+// The ttentry is only a snapshot of the table data here. The table stores the 64bit payload
+// (move, value, eval, depth, bound and age) with a single atomic write and the key xored
+// with a fold of the payload, so a key/payload pair of two different writes won't verify.
+#define TTPAYLOAD(e) ((U64)(e)->movecode | ((U64)(uint16_t)(e)->value << 16) | ((U64)(uint16_t)(e)->staticeval << 32) | ((U64)(e)->depth << 48) | ((U64)(e)->boundAndAge << 56))
+#define TTPAYLOADFOLD(H, d) (H)(((d) * 0x9e3779b97f4a7c15ULL) >> (64 - sizeof(H) * 8))
+
+template <class L> struct ttcluster {
+    atomic<U64> payload[L::buckets];
+    atomic<typename L::hashupper_t> key[L::buckets];
+    uint8_t padding[L::bytes - (sizeof(U64) + sizeof(typename L::hashupper_t)) * L::buckets];
+#else
+template <class L> struct ttcluster {
+    ttentryT<typename L::hashupper_t> entry[L::buckets];
+    uint8_t padding[L::bytes - sizeof(ttentryT<typename L::hashupper_t>) * L::buckets];
+#endif
 #ifdef SDEBUG
     U64 debugHash;
     int debugIndex;
@@ -1195,38 +1372,87 @@ struct transpositioncluster {
 #endif
 };
 
+typedef TTLAYOUT::hashupper_t hashupper_t;
+typedef ttentryT<hashupper_t> ttentry;
+typedef ttcluster<TTLAYOUT> transpositioncluster;
+#define TTBUCKETNUM (TTLAYOUT::buckets)
+#define GETHASHUPPER(x) (hashupper_t)((x) >> (64 - sizeof(hashupper_t) * 8))
+
+
+// Header of a saved transposition table; the table starts page aligned behind it
+#define TTFILEMAGIC         0x52545446  // "FTTR"
+#define TTFILEHEADERSIZE    0x10000
+
+struct ttfileheader {
+    uint32_t magic;
+    uint32_t bucketnum;
+    uint32_t entrysize;
+    uint32_t clustersize;
+    U64 size;
+    U64 zobristseed;
+    U64 zobristcheck;
+    uint32_t age;
+};
+
 
 #define FIXMATESCOREPROBE(v,p) (MATEFORME(v) ? (v) - p : (MATEFOROPPONENT(v) ? (v) + p : v))
 #define FIXMATESCOREADD(v,p) (MATEFORME(v) ? (v) + p : (MATEFOROPPONENT(v) ? (v) - p : v))
 #define FIXDEPTHFROMTT(d) (d + TTDEPTH_OFFSET)
 
-class transposition
+template <class L> class transpositiontable
 {
 public:
-    transpositioncluster *table;
+    typedef typename L::hashupper_t upper_t;
+    typedef ttentryT<upper_t> entry_t;
+    typedef ttcluster<L> cluster_t;
+    static upper_t getHashUpper(U64 h) { return (upper_t)(h >> (64 - sizeof(upper_t) * 8)); }
+
+    cluster_t *table;
     size_t size;
     size_t sizemask;
     uint8_t numOfSearchShiftTwo;
-    ~transposition();
+    size_t mappedsize = 0;      // size of the file mapping if the table was loaded from a file
+    upper_t samplekeys[TTSTATSAMPLES * L::buckets];    // keys of the sampled entries at start of the search
+    bool samplekeysvalid;
+    void freeTable();
+    cluster_t* sampleCluster(unsigned int i);
+    bool sampleEntry(cluster_t* cluster, int i, entry_t* e);
+    void fillFileHeader(ttfileheader* h);
+#ifdef TTLOCKFREE
+    atomic<U64> tornReads;      // probes that were rejected because of a concurrent write to the entry
+    bool readEntry(cluster_t* cluster, int i, entry_t* e);
+    void writeEntry(entry_t* e);
+#endif
+    ~transpositiontable();
     int setSize(int sizeMb);    // returns the number of Mb not used by allignment
     void clean();
-    void addHash(ttentry* entry, U64 hash, int val, int16_t staticeval, int bound, int depth, uint16_t movecode);
+    bool saveToFile(string filename);
+    bool loadFromFile(string filename);
+    void addHash(entry_t* entry, U64 hash, int val, int16_t staticeval, int bound, int depth, uint16_t movecode);
     void printHashentry(U64 hash);
-    ttentry* probeHash(U64 hash, bool *bFound);
+    // Returns the matching or the entry to be replaced; in TTLOCKFREE mode this is a copy in snapshot
+    entry_t* probeHash(U64 hash, bool *bFound, entry_t *snapshot);
     uint16_t getMoveCode(U64 hash);
     unsigned int getUsedinPermill();
-    void nextSearch() { numOfSearchShiftTwo = (numOfSearchShiftTwo + AGEINC) & AGEMASK; }
+    void printStats();
+    void nextSearch();
 #ifdef SDEBUG
     void markDebugSlot(U64 h, int i) {
         table[h & sizemask].debugHash = h; table[h & sizemask].debugIndex = i;
     }
     int isDebugPosition(U64 h) { return (h != table[h & sizemask].debugHash) ? -1 : table[h & sizemask].debugIndex; }
     string debugGetPv(U64 h, int p) {
-        transpositioncluster* data = &table[h & sizemask];
-        for (int i = 0; i < TTBUCKETNUM; i++)
+        cluster_t* data = &table[h & sizemask];
+        for (int i = 0; i < L::buckets; i++)
         {
-            ttentry *e = &(data->entry[i]);
-            if (e->hashupper == GETHASHUPPER(h))
+#ifdef TTLOCKFREE
+            entry_t snapshot;
+            entry_t *e = &snapshot;
+            if (readEntry(data, i, e) && e->hashupper == getHashUpper(h))
+#else
+            entry_t *e = &(data->entry[i]);
+            if (e->hashupper == getHashUpper(h))
+#endif
                 return "Depth=" + to_string(e->depth) + " Value=" + to_string(FIXMATESCOREPROBE(e->value, p)) + "(" + to_string(e->boundAndAge & BOUNDMASK) + ")  pv=" + data->debugStoredBy;
         }
         return "";
@@ -1239,6 +1465,8 @@ public:
 #endif
 };
 
+typedef transpositiontable<TTLAYOUT> transposition;
+
 
 typedef struct pawnhashentry {
     uint32_t hashupper;
@@ -1360,7 +1588,6 @@ const int lva[] = { 5 << 24, 4 << 24, 3 << 24, 3 << 24, 2 << 24, 1 << 24, 0 << 2
 #define KILLERVAL1 (1 << 26)
 #define KILLERVAL2 (KILLERVAL1 - 1)
 #define NMREFUTEVAL (1 << 25)
-#define BADTACTICALFLAG (1 << 31)
 
 
 // 32bit move code has the following format
@@ -1539,6 +1766,29 @@ struct chessmovestack
     unsigned int threatSquare;
 };
 
+#ifdef SEECACHE
+// Attackers of the target squares SEE was asked for in the position with the given hash
+// The attacker sets don't depend on the moving piece, so they are shared by all moves of a node to the same square
+struct seeattackercache
+{
+    U64 hash;
+    U64 valid;
+    U64 attackers[64];
+};
+#endif
+
+#ifdef COPYMAKE
+// Copy of the board block of chessposition (piece00 ... phcount) for copy-make
+struct alignas(64) chessboardstack
+{
+    U64 piece00[14];
+    uint8_t mailbox[BOARDSIZE];
+    int piececount;
+    int psqval;
+    int phcount;
+};
+#endif
+
 #define MAXMOVELISTLENGTH 256   // for lists of possible pseudo-legal moves
 
 string moveToString(uint32_t mc);
@@ -1548,17 +1798,38 @@ class chessmovelist
 public:
     int length;
     chessmove move[MAXMOVELISTLENGTH];
-#ifdef SDEBUG
-    int lastvalue;
-#endif
 	chessmovelist();
 	string toString();
 	void print();
-    chessmove* getNextMove(int minval = INT_MIN);
-    uint32_t getAndRemoveNextMove();
 };
 
 
+// Move list of the MoveSelector with codes and values stored in separate arrays
+// Moves with a value of at least the sort limit are sorted by insertion when the list is filled and delivered in order,
+// the remaining moves are picked by a vectorized search for the maximum value.
+// Bad captures of a sorted list are moved to its front for the bad captures stage.
+#define SELECTORLISTPADDING 8   // INT_MIN values after the last move for whole vector loads
+class alignas(64) selectormovelist
+{
+public:
+    int value[MAXMOVELISTLENGTH + SELECTORLISTPADDING];
+    uint32_t code[MAXMOVELISTLENGTH];
+    int length;
+    int sorted;     // moves [0, sorted) are in descending order
+    int current;    // next sorted move to deliver; start of the unsorted moves when all sorted moves are delivered
+    int bad;        // moves [0, bad) are the bad captures in descending order
+    int badcurrent; // next bad capture to deliver
+#ifdef SDEBUG
+    int lastvalue;
+#endif
+    uint32_t getNextMove(int minval = INT_MIN);
+    void keepAsBad();
+    uint32_t getNextBadMove();
+};
+
+#define QUIETSORTLIMIT 16384   // quiets with a lower value are picked by maximum search instead of being sorted
+
+
 enum MoveSelector_State { HASHMOVESTATE, TACTICALINITSTATE, TACTICALSTATE, KILLERMOVE1STATE, KILLERMOVE2STATE,
     COUNTERMOVESTATE, QUIETINITSTATE, QUIETSTATE, BADTACTICALSTATE, BADTACTICALEND, EVASIONINITSTATE, EVASIONSTATE };
 
@@ -1566,8 +1837,8 @@ class MoveSelector
 {
 public:
     chessposition *pos;
-    chessmovelist* captures;
-    chessmovelist* quiets;
+    selectormovelist* captures;
+    selectormovelist* quiets;
     int state;
     bool onlyGoodCaptures;
     uint32_t hashmove;
@@ -1656,16 +1927,37 @@ struct AccumulatorCache {
 // Replace the occupied bitboards with the first two so far unused piece bitboards
 #define occupied00 piece00
 
+// The large buffers of the search that are rarely touched as a whole
+// They are allocated at first use by the thread that searches so the hot part of chessposition stays small
+struct searchbuffers
+{
+    U64 nodespermove[0x10000];
+    selectormovelist captureslist[MAXDEPTH];
+    selectormovelist quietslist[MAXDEPTH];
+    selectormovelist singularcaptureslist[MAXDEPTH];
+    selectormovelist singularquietslist[MAXDEPTH];
+    chessmovelist selectorgenlist;  // moves are generated here and copied to the lists of the MoveSelector
+    uint32_t pvtable[MAXDEPTH][MAXDEPTH];
+    uint32_t multipvtable[MAXMULTIPV][MAXDEPTH];
+    uint32_t quietMoves[MAXDEPTH][MAXMOVELISTLENGTH];
+    uint32_t tacticalMoves[MAXDEPTH][MAXMOVELISTLENGTH];
+    alignas(64) MoveSelector moveSelector[MAXDEPTH];
+    MoveSelector extensionMoveSelector[MAXDEPTH];
+};
+
 class chessposition
 {
 public:
     // everything up to member 'history' is copied from rootpos to every thread's position in engine::prepareThreads()
     int ply;
+    // The board block from piece00 to phcount fills three cache lines and is saved to the boardstack in the COPYMAKE build
+    alignas(64) U64 piece00[14];
+    uint8_t mailbox[BOARDSIZE];
     int piececount;
-    U64 piece00[14];
+    int psqval;
+    int phcount;                    // weighted number of pieces (0..24)
     U64 attackedBy2[2];
     U64 attackedBy[2][7];
-    uint8_t mailbox[BOARDSIZE];
     U64 threats;
 
     // The following block is mapped/copied to the movestack, so its important to keep the order
@@ -1688,8 +1980,6 @@ public:
     uint32_t killer[MAXDEPTH][2];   // Hmmm. killer[0][] not initialized/reset to 0??
     uint32_t bestFailingLow;        // Hmmm. bestFailingLow not initialized/reset to 0??
     int failhighcount[MAXDEPTH];
-    int psqval;
-    int phcount;                    // weighted number of pieces (0..24)
     int contempt;
     int useTb;
     int useRootmoveScore;
@@ -1730,32 +2020,41 @@ public:
     // The following members (almost) don't need an init
     int seldepth;
     int sc;
-    U64 nodespermove[0x10000];                      // init in prepare only for thread #0
-    chessmovelist captureslist[MAXDEPTH];
-    chessmovelist quietslist[MAXDEPTH];
-    chessmovelist singularcaptureslist[MAXDEPTH];
-    chessmovelist singularquietslist[MAXDEPTH];
-    uint32_t pvtable[MAXDEPTH][MAXDEPTH];
-    uint32_t multipvtable[MAXMULTIPV][MAXDEPTH];
+    // Pointers into the searchbuffers; allocBuffers() has to be called before searching
+    searchbuffers* buffers;
+    U64* nodespermove;                              // init in prepare only for thread #0
+    selectormovelist* captureslist;
+    selectormovelist* quietslist;
+    selectormovelist* singularcaptureslist;
+    selectormovelist* singularquietslist;
+    chessmovelist* selectorgenlist;
+    uint32_t (*pvtable)[MAXDEPTH];
+    uint32_t (*multipvtable)[MAXDEPTH];
+    uint32_t (*quietMoves)[MAXMOVELISTLENGTH];
+    uint32_t (*tacticalMoves)[MAXMOVELISTLENGTH];
+    MoveSelector* moveSelector;
+    MoveSelector* extensionMoveSelector;
     uint32_t lastpv[MAXDEPTH];
     int CurrentMoveNum[MAXDEPTH];
     chessmovestack prerootmovestack[PREROOTMOVES];      // explicit copy from rootpos up to frame prerootmovenum including first frame of regular stack
     chessmovestack movestack[MAXDEPTH];                 // frame 0 copied from rootpos
+#ifdef COPYMAKE
+    chessboardstack boardstack[MAXDEPTH];               // board before the move of each ply
+#endif
     uint32_t prerootmovecode[PREROOTMOVES];             // explicit copy from rootpos up to frame prerootmovenum including first regular movecode
     uint32_t movecode[MAXDEPTH];
     uint16_t excludemovestack[MAXDEPTH];                // init in prepare only for excludemovestack[0]
     int16_t staticevalstack[MAXDEPTH];
     Materialhash mtrlhsh;                               // init in alloc
     Pawnhash pwnhsh;                                    // init in alloc
-    bool computationState[MAXDEPTH][2];
+    bool computationState[MAXDEPTH + 1][2];             // one more than the stack to invalidate the grandchild in playMove
     int16_t* accumulation;
     int32_t* psqtAccumulation;
     AccumulatorCache accucache;
     DirtyPiece dirtypiece[MAXDEPTH];
-    uint32_t quietMoves[MAXDEPTH][MAXMOVELISTLENGTH];
-    uint32_t tacticalMoves[MAXDEPTH][MAXMOVELISTLENGTH];
-    alignas(64) MoveSelector moveSelector[MAXDEPTH];
-    MoveSelector extensionMoveSelector[MAXDEPTH];
+#ifdef SEECACHE
+    seeattackercache seecache[MAXDEPTH];                // attackers per target square for SEE, valid for the position with matching hash
+#endif
 #ifdef SDEBUG
     int pvmovevalue[MAXDEPTH];
     int pvalpha[MAXDEPTH];
@@ -1799,6 +2098,8 @@ public:
     void getRootMoves();
     void tbFilterRootMoves();
     void prepareStack();
+    void allocBuffers();
+    void freeBuffers();
     string movesOnStack();
     template <bool LiteMode> bool playMove(uint32_t mc);
     template <bool LiteMode> void unplayMove(uint32_t mc);
@@ -1840,10 +2141,15 @@ public:
     inline bool CheckForImmediateStop();
     int CreateEvasionMovelist(chessmove* mstart);
     template <MoveType Mt> int CreateMovelist(chessmove* mstart);
+    template <MoveType Mt> int CreateLegalMovelist(chessmove* mstart);
+    template <MoveType Mt, Color me> inline int CreateLegalMovelist(chessmove* mstart);
+    template <MoveType Mt, Color me> inline int CreateLegalMovelistPieces(chessmove* mstart, U64 occupiedbits, U64 targetbits);
     template <PieceType Pt, Color me> inline int CreateMovelistPiece(chessmove* mstart, U64 occ, U64 targets);
     template <MoveType Mt, Color me> inline int CreateMovelistPawn(chessmove* mstart);
     template <Color me> inline int CreateMovelistCastle(chessmove* mstart);
+    template <MoveType Mt> inline int getMoveValue(uint32_t mc);
     template <MoveType Mt> void evaluateMoves(chessmovelist* ml);
+    template <MoveType Mt> void evaluateMoves(chessmovelist* ml, selectormovelist* sl, int sortlimit);
     int probe_wdl(int* success);
     int probe_dtz(int* success);
     int root_probe_dtz();
@@ -1860,17 +2166,17 @@ public:
     template <NnueType Nt, Color c> void HalfkpAppendActiveIndices(NnueIndexList *active);
     template <NnueType Nt, Color c> void HalfkpAppendChangedIndices(DirtyPiece* dp, NnueIndexList *add, NnueIndexList *remove);
     template <NnueType Nt, Color c, int N> bool GetAcccumulatorUpdateArray(int* updaterequest);
-    template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, int N> void AccumulatorIncrementalUpdate(int* updaterequest);
-    template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> void AccumulatorRefresh();
-    template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> void AccumulatorUpdate();
-    template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> void AccumulatorSpeculativeUpdate();
+    template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, int N, typename ftweight_t = int16_t> int AccumulatorIncrementalUpdate(int* updaterequest);
+    template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t = int16_t> int AccumulatorRefresh();
+    template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t = int16_t> void AccumulatorUpdate();
+    template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t = int16_t> void AccumulatorSpeculativeUpdate();
 #ifdef NNUEDEBUG
     template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> void AccumulatorDebug();
 #endif
 
-    template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> int Transform(clipped_t *output, int bucket = 0);
+    template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t = int16_t> int Transform(clipped_t *output, int bucket = 0);
 
-    template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> void SpeculativeTransform();
+    template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t = int16_t> void SpeculativeTransform();
     int NnueGetEval();
     void NnueSpeculativeEval();
 
@@ -1955,7 +2261,7 @@ public:
 };
 
 
-enum GuiToken { UNKNOWN, UCI, UCIDEBUG, ISREADY, SETOPTION, REGISTER, UCINEWGAME, POSITION, GO, STOP, WAIT, PONDERHIT, QUIT, EVAL, PERFT, BENCH, TUNE, GENSFEN, CONVERT, LEARN, EXPORT, STATS };
+enum GuiToken { UNKNOWN, UCI, UCIDEBUG, ISREADY, SETOPTION, REGISTER, UCINEWGAME, POSITION, GO, STOP, WAIT, PONDERHIT, QUIT, EVAL, PERFT, BENCH, TUNE, GENSFEN, CONVERT, LEARN, EXPORT, STATS, SAVEHASH, LOADHASH, TTSTATS };
 
 const map<string, GuiToken> GuiCommandMap = {
     { "export", EXPORT },
@@ -1984,7 +2290,10 @@ const map<string, GuiToken> GuiCommandMap = {
     { "wait", WAIT },
     { "eval", EVAL },
     { "perft", PERFT },
-    { "bench", BENCH }
+    { "bench", BENCH },
+    { "savehash", SAVEHASH },
+    { "loadhash", LOADHASH },
+    { "ttstats", TTSTATS }
 };
 
 class engine;   //forward definition
@@ -2036,12 +2345,14 @@ enum ponderstate_t { NO, PONDERING };
 #define CPUNEON     (1 << 8)
 #define CPUARM64    (1 << 9)
 #define CPUDOTPROD  (1 << 10)
+#define CPUAVXVNNI  (1 << 11)
+#define CPUAVX512VNNI (1 << 12)
 
 class compilerinfo
 {
-    const string strCpuFeatures[11] = { "sse2","ssse3","popcnt","lzcnt","bmi1","avx2","bmi2", "avx512", "neon", "arm64", "dotprod"};
+    const string strCpuFeatures[13] = { "sse2","ssse3","popcnt","lzcnt","bmi1","avx2","bmi2", "avx512", "neon", "arm64", "dotprod", "avxvnni", "avx512vnni"};
 public:
-    const U64 binarySupports = 0ULL
+    static constexpr U64 binarySupports = 0ULL
 #ifdef USE_POPCNT
         | CPUPOPCNT
 #endif
@@ -2071,6 +2382,12 @@ public:
 #endif
 #ifdef USE_DOTPROD
         | CPUDOTPROD
+#endif
+#ifdef USE_AVXVNNI
+        | CPUAVXVNNI
+#endif
+#ifdef USE_VNNI
+        | CPUAVX512VNNI
 #endif
         ;
 
@@ -2086,6 +2403,53 @@ public:
     int GetProcessId();
 };
 
+#ifdef FATARCH
+// Entry point and cpu features of this architecture when linked into a fat binary
+int archmain(int argc, char* argv[]);
+extern const U64 fatArchSupports;
+#endif
+
+
+
+//
+// NUMA stuff
+//
+#if defined(__linux__) && !defined(__ANDROID__)
+#define NUMASUPPORT
+#endif
+
+enum NumaPolicy { NumaOff, NumaBind, NumaInterleave };
+#define NUMAPOLICIES "Off Bind Interleave"
+
+class numaconfig
+{
+public:
+    int policy = NumaOff;
+    int nodes = 0;                  // number of nodes with cpus usable by this process
+    bool uselibnuma = false;
+#ifdef NUMASUPPORT
+    vector<int> nodeid;             // system id of the node
+    vector<vector<int>> nodecpus;   // usable cpus of the node
+    vector<int> allowedcpus;        // cpus of the process before any binding
+#endif
+    void init();
+    void setPolicy(string p);
+    bool active() { return policy != NumaOff && nodes > 0; }
+    int nodeOfThread(int i) { return i % nodes; }
+    void bindThisThread(int node);  // node < 0 releases an earlier binding
+    void unbindThisThread();
+    void interleave(void* p, size_t size);
+};
+
+extern numaconfig numa;
+
+
+// Statistics of a root move shared by all search threads
+struct rootmovestat
+{
+    atomic<U64> nodes;
+    atomic<unsigned int> alpharaises;  // how often the move raised alpha (became the new best move) in any thread
+};
 
 
 class engine
@@ -2123,6 +2487,7 @@ public:
     bool Syzygy50MoveRule = true;
     int SyzygyProbeLimit;
     string BookFile;
+    string HashFile;
     bool BookBestMove;
     int BookDepth;
     int Contempt;
@@ -2142,6 +2507,13 @@ public:
     bool prepared;
     string benchmove;
     string benchpondermove;
+    bool threadVoting;
+    bool nnueLazyUpdate;
+    int nnueEvalCacheSize;              // UCI option NNUEEvalCache in MByte, 0 disables the cache
+    thread nnueLoader;                  // reads a new network in the background while searching
+    atomic<bool> nnueLoaderDone;
+    NnueNetsource* nnuePending = nullptr;   // network loaded by nnueLoader waiting to be swapped in
+    rootmovestat rootmovestats[0x10000];   // indexed by the 16bit move code like nodespermove
     ucioptions_t ucioptions;
     compilerinfo* compinfo;
     string ExecPath;
@@ -2183,8 +2555,11 @@ public:
         else
             return "<unknown>";
     }
-#ifdef _WIN32
+#ifdef LARGEPAGESUPPORT
     bool allowlargepages;
+#endif
+#ifdef NUMASUPPORT
+    string NumaPolicy;
 #endif
     string name(bool full = true) {
         string sbinary = compinfo->PrintCpuFeatures(compinfo->binarySupports, true);
@@ -2204,9 +2579,19 @@ public:
     GuiToken parse(vector<string>*, string ss);
     void communicate(string inputstring);
     void allocThreads();
+    void allocAccumulators();
+    void freeAccumulators();
+    void loadNnueInBackground();
+    void swapPendingNnue(bool wait);
     void getNodesAndTbhits(U64 *nodes, U64 *tbhits);
-    U64 perft(int depth, bool printsysteminfo = false);
+    U64 perft(int depth, bool printsysteminfo = false, int hashMb = 0);
     void bench(int constdepth, string epdfilename, int consttime, int startnum, bool openbench);
+    void benchTT(int depth);
+    void benchScaling(int maxthreads, int depth);
+    void benchNnueBatch(int n, int batchsize);
+    void benchNnueCompare(string netfile, int n);
+    void benchNnueKernels(int n);
+    void benchEvalCache(int depth);
     void prepareThreads();
     void resetStats();
     void registerOptions();
@@ -2356,7 +2741,6 @@ class searchthread
 public:
     uint64_t toppadding[8];
     chessposition pos;
-    thread thr;
     int index;
     int depth;
     int lastCompleteDepth;
@@ -2374,6 +2758,33 @@ public:
 void searchinit();
 template <RootsearchType RT> void mainSearch(searchthread* thr);
 
+
+//
+// Persistent worker threads that park on a condition variable between their jobs
+// Worker i runs the jobs of searchthread i (search, gensfen, convert) and parts of tt clean
+//
+class threadpool
+{
+    struct worker {
+        thread thr;
+        mutex mtx;
+        condition_variable cv;
+        function<void()> job;
+        bool busy = false;
+        bool exit = false;
+    };
+    vector<worker*> workers;
+    static void idleLoop(worker* w);
+public:
+    ~threadpool() { resize(0); }
+    void resize(int n);
+    int size() { return (int)workers.size(); }
+    void run(int i, function<void()> job);
+    void wait(int i);
+};
+
+extern threadpool pool;
+
 //
 // TB stuff
 //
@@ -2442,6 +2853,18 @@ public:
     U64 nnue_accupdate_cache;   // total number of already up-to-date accumulators
     U64 nnue_accupdate_inc;     // total number of incremental updates
     U64 nnue_accupdate_full;    // total number of full updates
+    U64 nnue_accupdate_back;    // total number of incremental updates backward from the computed child
+    U64 nnue_accupdate_lazy;    // total number of speculative updates skipped in lazy mode
+    U64 nnue_accupdate_skip;    // total number of accumulators on the stack skipped by incremental updates
+    U64 nnue_refresh_features;  // total number of features added or removed by full updates from the accumulator cache
+    U64 nnue_evalcache_probe;   // total number of probes of the NNUE evaluation cache
+    U64 nnue_evalcache_hit;     // total number of evaluations found in the NNUE evaluation cache
+    U64 see_n;                  // total calls to see
+    U64 see_trivial;            // see calls decided by the values of the move alone
+    U64 see_attackers;          // see calls that needed the attackers of the target square
+#ifdef SEECACHE
+    U64 see_cachehit;           // attackers of the target square found in the per ply see cache
+#endif
 
 #define MAXSTATDEPTH 30
 #define MAXSTATMOVES 128
@@ -2457,6 +2880,9 @@ public:
     U64 ms_badtactic_moves[2][MAXSTATDEPTH];            // total number of special quiet moves delivered in depth n
     U64 ms_evasion_stage[2][MAXSTATDEPTH][MAXSTATMOVES];// how many times was the evasion stage entered with a move list of length m
     U64 ms_evasion_moves[2][MAXSTATDEPTH][MAXSTATMOVES];// total number of evasion moves delivered in depth n with a move list of length m
+    U64 ms_cutoff_n[2][MAXSTATDEPTH];                   // total number of beta cutoffs in depth n
+    U64 ms_cutoff_index[2][MAXSTATDEPTH];               // sum of the indices of the cutoff move (first legal move = 1)
+    U64 ms_cutoff_first[2][MAXSTATDEPTH];               // total number of beta cutoffs by the first legal move
 
     double ebf_per_depth_sum[MAXSTATDEPTH];
     U64 ebf_per_depth_n[MAXSTATDEPTH];
@@ -2517,9 +2943,13 @@ namespace Simd {
 #if USE_AVX512
     // 512bit intrinsics
     inline void m512_add_dpbusd_32(__m512i& acc, __m512i a, __m512i b) {
+#if defined (USE_VNNI)
+        acc = _mm512_dpbusd_epi32(acc, a, b);
+#else
         __m512i product0 = _mm512_maddubs_epi16(a, b);
         product0 = _mm512_madd_epi16(product0, _mm512_set1_epi16(1));
         acc = _mm512_add_epi32(acc, product0);
+#endif
     }
 
     inline void m512_add_dpbusd_32x2(__m512i& acc, __m512i a0, __m512i b0,  __m512i a1, __m512i b1) {
@@ -2564,18 +2994,33 @@ namespace Simd {
 
 #ifdef USE_AVX2
     // 256bit intrinsics
+    // vpdpbusd on 256bit registers is EVEX encoded with AVX512-VNNI+VL and VEX encoded with AVX-VNNI
     inline void m256_add_dpbusd_32(__m256i& acc, __m256i a, __m256i b) {
+#if defined (USE_VNNI)
+        acc = _mm256_dpbusd_epi32(acc, a, b);
+#elif defined (USE_AVXVNNI)
+        acc = _mm256_dpbusd_avx_epi32(acc, a, b);
+#else
         __m256i product0 = _mm256_maddubs_epi16(a, b);
         product0 = _mm256_madd_epi16(product0, _mm256_set1_epi16(1));
         acc = _mm256_add_epi32(acc, product0);
+#endif
     }
 
     inline void m256_add_dpbusd_32x2(__m256i& acc, __m256i a0, __m256i b0, __m256i a1, __m256i b1) {
+#if defined (USE_VNNI)
+        acc = _mm256_dpbusd_epi32(acc, a0, b0);
+        acc = _mm256_dpbusd_epi32(acc, a1, b1);
+#elif defined (USE_AVXVNNI)
+        acc = _mm256_dpbusd_avx_epi32(acc, a0, b0);
+        acc = _mm256_dpbusd_avx_epi32(acc, a1, b1);
+#else
         __m256i product0 = _mm256_maddubs_epi16(a0, b0);
         __m256i product1 = _mm256_maddubs_epi16(a1, b1);
         product0 = _mm256_adds_epi16(product0, product1);
         product0 = _mm256_madd_epi16(product0, _mm256_set1_epi16(1));
         acc = _mm256_add_epi32(acc, product0);
+#endif
     }
 
     inline int m256_hadd(__m256i sum, int bias) {
@@ -2678,10 +3123,11 @@ namespace Simd {
 }
 
 
+void init_tablebases(char *path);
+
 } // namespace rubichess
 
 
-void init_tablebases(char *path);
 #ifdef NNUEINCLUDED
 extern const char  _binary_net_nnue_start;
 extern const char  _binary_net_nnue_end;
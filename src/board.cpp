@@ -311,6 +311,33 @@ void chessposition::prepareStack()
 }
 
 
+void chessposition::allocBuffers()
+{
+    if (buffers)
+        return;
+    buffers = new (my_large_malloc(sizeof(searchbuffers))) searchbuffers();
+    nodespermove = buffers->nodespermove;
+    captureslist = buffers->captureslist;
+    quietslist = buffers->quietslist;
+    singularcaptureslist = buffers->singularcaptureslist;
+    singularquietslist = buffers->singularquietslist;
+    selectorgenlist = &buffers->selectorgenlist;
+    pvtable = buffers->pvtable;
+    multipvtable = buffers->multipvtable;
+    quietMoves = buffers->quietMoves;
+    tacticalMoves = buffers->tacticalMoves;
+    moveSelector = buffers->moveSelector;
+    extensionMoveSelector = buffers->extensionMoveSelector;
+}
+
+
+void chessposition::freeBuffers()
+{
+    my_large_free(buffers);
+    buffers = nullptr;
+}
+
+
 // This is mainly for detecting discovered attacks on the queen so we exclude enemy queen from the test
 template <int Me> bool chessposition::sliderAttacked(int index, U64 occ)
 {
@@ -1050,25 +1077,61 @@ bool chessposition::see(uint32_t move, int threshold)
 
     int value = GETTACTICALVALUE(move) - threshold;
 
+    STATISTICSINC(see_n);
+
     if (value < 0)
+    {
         // the move itself is not good enough to reach the threshold
+        STATISTICSINC(see_trivial);
         return false;
+    }
 
     int nextPiece = (ISPROMOTION(move) ? GETPROMOTION(move) : GETPIECE(move)) >> 1;
 
     value -= materialvalue[nextPiece];
 
     if (value >= 0)
+    {
         // the move is good enough even if the piece is recaptured
+        STATISTICSINC(see_trivial);
         return true;
+    }
 
     // Now things get a little more complicated...
-    U64 seeOccupied = ((occupied00[0] | occupied00[1]) ^ BITSET(from)) | BITSET(to);
+    STATISTICSINC(see_attackers);
+    U64 occ = occupied00[0] | occupied00[1];
+    U64 seeOccupied = (occ ^ BITSET(from)) | BITSET(to);
     U64 potentialRookAttackers = (piece00[WROOK] | piece00[BROOK] | piece00[WQUEEN] | piece00[BQUEEN]);
     U64 potentialBishopAttackers = (piece00[WBISHOP] | piece00[BBISHOP] | piece00[WQUEEN] | piece00[BQUEEN]);
 
+#ifdef SEECACHE
+    // Get the attackers of the target square from the cache of this node or compute them for all moves to this square
+    seeattackercache* sac = &seecache[ply];
+    if (sac->hash != hash)
+    {
+        sac->hash = hash;
+        sac->valid = 0ULL;
+    }
+    if (!(sac->valid & BITSET(to)))
+    {
+        sac->attackers[to] = attackedByBB(to, occ);
+        sac->valid |= BITSET(to);
+    }
+    else {
+        STATISTICSINC(see_cachehit);
+    }
+
+    // Remove the moved piece and add the slider behind it; a knight is never on a line with the target square
+    U64 attacker = sac->attackers[to];
+    if ((fileMask[to] | rankMask[to]) & BITSET(from))
+        attacker |= (ROOKATTACKS(seeOccupied, to) & potentialRookAttackers);
+    else if (!(knight_attacks[to] & BITSET(from)))
+        attacker |= (BISHOPATTACKS(seeOccupied, to) & potentialBishopAttackers);
+#else
     // Get attackers excluding the already moved piece
-    U64 attacker = attackedByBB(to, seeOccupied) & seeOccupied;
+    U64 attacker = attackedByBB(to, seeOccupied);
+#endif
+    attacker &= seeOccupied;
 
     int s2m = (state & S2MMASK) ^ S2MMASK;
 
@@ -1143,6 +1206,7 @@ int chessposition::getBestPossibleCapture()
 alignas(64) compilerinfo cinfo;
 alignas(64) EPSCONST evalparamset eps;
 alignas(64) zobrist zb;
+threadpool pool;   // defined before the engine so it outlives it
 alignas(64) engine en(&cinfo);
 alignas(64) SPSCONST searchparamset sps;
 alignas(64) GuiCommunication guiCom;
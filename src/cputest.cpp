@@ -26,13 +26,15 @@ using namespace rubichess;
 #if defined _MSC_VER && !defined(__clang_major__)
 #include <intrin.h>
 #define CPUID(x,i) __cpuid(x, i)
+#define CPUIDEX(x,i,s) __cpuidex(x, i, s)
 #endif
 
 #if defined(__MINGW64__) || defined(__gnu_linux__) || defined(__clang_major__) || defined(__GNUC__)
 #include <cpuid.h>
-#define CPUID(x,i) cpuid(x, i)
-static void cpuid(int32_t out[4], int32_t x) {
-    __cpuid_count(x, 0, out[0], out[1], out[2], out[3]);
+#define CPUID(x,i) cpuid(x, i, 0)
+#define CPUIDEX(x,i,s) cpuid(x, i, s)
+static void cpuid(int32_t out[4], int32_t x, int32_t s) {
+    __cpuid_count(x, s, out[0], out[1], out[2], out[3]);
 }
 #endif
 
@@ -89,6 +91,14 @@ void compilerinfo::GetSystemInfo()
             if (CPUInfo[1] & (1 << 8)) machineSupports |= CPUBMI2;
             if (CPUInfo[1] & (1 << 5)) machineSupports |= CPUAVX2;
             if (CPUInfo[1] & ((1 << 16) | (1 << 30))) machineSupports |= CPUAVX512; // AVX512F + AVX512BW needed
+            if ((machineSupports & CPUAVX512) && (CPUInfo[1] & (1U << 31)) && (CPUInfo[2] & (1 << 11)))
+                machineSupports |= CPUAVX512VNNI;   // AVX512VL + AVX512_VNNI for vpdpbusd on 256 and 512 bit registers
+            int maxSubleaf = CPUInfo[0];
+            if (maxSubleaf >= 1)
+            {
+                CPUIDEX(CPUInfo, 7, 1);
+                if ((machineSupports & CPUAVX2) && (CPUInfo[0] & (1 << 4))) machineSupports |= CPUAVXVNNI;
+            }
         }
     }
 
@@ -137,6 +147,9 @@ void compilerinfo::GetSystemInfo()
 
 #ifndef CPUTEST
     U64 supportedButunused = machineSupports & ~binarySupports;
+    if (binarySupports & CPUAVX512VNNI)
+        // the VEX encoded AVX-VNNI has nothing to add to AVX512-VNNI
+        supportedButunused &= ~CPUAVXVNNI;
     if (supportedButunused)
         cout << "info string Warning! Binary not optimal for this machine. Unused cpu features: " + PrintCpuFeatures(supportedButunused) + ". Please use correct binary for best performance.\n";
 #endif
@@ -184,6 +197,47 @@ string compilerinfo::PrintCpuFeatures(U64 f, bool onlyHighest)
 
 #ifdef CPUTEST
 
+#ifdef FATBINARY
+// Dispatcher of a fat binary: Each architecture in FATARCHLIST is a complete build of the engine in namespace
+// rubichess_<arch>. The Makefile moves its static initializers to section fatinit_<arch>, so only the
+// initializers of the selected architecture run before its entry point is called.
+typedef void (*fatinit_t)();
+
+#define FATARCH(a) \
+    namespace rubichess_##a { int archmain(int argc, char* argv[]); extern const U64 fatArchSupports; } \
+    extern "C" fatinit_t __start_fatinit_##a[], __stop_fatinit_##a[];
+FATARCHLIST
+#undef FATARCH
+
+int main(int argc, char* argv[])
+{
+    struct fatarch {
+        U64 supports;
+        int (*archmain)(int argc, char* argv[]);
+        fatinit_t* initstart;
+        fatinit_t* initstop;
+    } fatarchs[] = {
+#define FATARCH(a) { rubichess_##a::fatArchSupports, rubichess_##a::archmain, __start_fatinit_##a, __stop_fatinit_##a },
+        FATARCHLIST
+#undef FATARCH
+    };
+
+    // FATARCHLIST is ordered from best to most compatible architecture
+    compilerinfo ci;
+    for (auto& fa : fatarchs)
+    {
+        if (fa.supports & ~ci.machineSupports)
+            continue;
+        for (fatinit_t* f = fa.initstart; f < fa.initstop; f++)
+            (*f)();
+        return fa.archmain(argc, argv);
+    }
+
+    cout << "info string Error! This machine supports none of the architectures in this fat binary.\n";
+    return -1;
+}
+
+#else
 int main()
 {
     compilerinfo ci;
@@ -191,5 +245,6 @@ int main()
     cout << ci.PrintCpuFeatures(ci.machineSupports) << "\n";
 
 }
+#endif
 
 #endif
@@ -30,7 +30,12 @@ void engineHeader()
     guiCom << "----------------------------------------------------------------------------------------\n";
     guiCom << "System: " + cinfo.SystemName() + "\n";
     guiCom << "CPU-Features of system: " + cinfo.PrintCpuFeatures(cinfo.machineSupports) + "\n";
+#ifdef FATARCH
+    guiCom << "CPU-Features of binary: " + cinfo.PrintCpuFeatures(cinfo.binarySupports) + " (selected from fat binary)\n";
+#else
     guiCom << "CPU-Features of binary: " + cinfo.PrintCpuFeatures(cinfo.binarySupports) + "\n";
+#endif
+    guiCom << "Memory per thread: " + to_string(sizeof(searchthread) >> 10) + " KByte state + " + to_string(sizeof(searchbuffers) >> 10) + " KByte search buffers at first use\n";
     guiCom << "========================================================================================\n";
 }
 
@@ -39,20 +44,15 @@ void engineHeader()
 //
 // callbacks for ucioptions
 //
-#ifdef _WIN32
+#ifdef LARGEPAGESUPPORT
 static void uciAllowLargePages()
 {
     if (!en.Hash)
         return;
-    printf("info string Reallocating hash table %s large pages\n", en.allowlargepages ? "using" : "without");
-    // This gets a little tricky
-    // First reset to old value and free the TT
-    en.allowlargepages = !en.allowlargepages;
-    tp.setSize(0);
-
-    // Now back to new value and allocate TT
-    en.allowlargepages = !en.allowlargepages;
+    printf("info string Reallocating hash table and thread data %s large pages\n", en.allowlargepages ? "using" : "without");
+    // Large page allocations are registered so they can be freed independent of the new setting
     tp.setSize(en.Hash);
+    en.allocThreads();
 }
 #endif
 
@@ -75,7 +75,36 @@ static void uciSetHash()
 static void uciClearHash()
 {
     tp.clean();
+    nnuecache.clean();
+}
+
+static void uciSetEvalCache()
+{
+    nnuecache.setSize(en.nnueEvalCacheSize);
+}
+
+#ifdef NUMASUPPORT
+static void uciSetNumaPolicy()
+{
+    numa.setPolicy(en.NumaPolicy);
+    if (!numa.active())
+    {
+        // release the binding of the workers by an earlier policy
+        for (int i = 0; i < pool.size(); i++)
+            pool.run(i, [] { numa.unbindThisThread(); });
+        for (int i = 0; i < pool.size(); i++)
+            pool.wait(i);
+        numa.unbindThisThread();
+    }
+    if (!en.Hash)
+        // called at registration; hash and threads are not allocated yet
+        return;
+    // reallocate hash and thread data to place them according to the new policy
+    tp.setSize(0);
+    tp.setSize(en.Hash);
+    en.allocThreads();
 }
+#endif
 
 static void uciSetSyzygyParam()
 {
@@ -141,13 +170,34 @@ static void uciSetNnuePath()
         return;
     }
 
+    if (en.stopLevel != ENGINETERMINATEDSEARCH)
+    {
+        // Keep the current network for the running search and swap in the new one before the next search
+        en.loadNnueInBackground();
+        return;
+    }
+
+    en.swapPendingNnue(true);
     NnueReady = NnueDisabled;
     NnueNetsource nr;
 
     if (!nr.open())
     {
         guiCom << "info string Failed to open network.\n";
+        return;
     }
+    NnueSwap(nr.arch, nr.nt);
+    nr.arch = nullptr;
+}
+
+// The network path is the only option that may be changed while searching
+static bool isNnueNetpathOption(vector<string>* args)
+{
+    if (args->size() < 2)
+        return false;
+    string sLower = (*args)[1];
+    transform(sLower.begin(), sLower.end(), sLower.begin(), ::tolower);
+    return (sLower == "nnuenetpath");
 }
 
 static void uciSetContempt()
@@ -194,6 +244,10 @@ engine::~engine()
     allocThreads();
     rootposition.pwnhsh.remove();
     rootposition.mtrlhsh.remove();
+    nnuecache.remove();
+    if (nnueLoader.joinable())
+        nnueLoader.join();
+    delete nnuePending;
     NnueRemove();
 }
 
@@ -204,19 +258,26 @@ void engine::registerOptions()
     ucioptions.Register(&NnueNetpath, "NNUENetpath", ucistring, "<Default>", 0, 0, uciSetNnuePath);
 #endif
     ucioptions.Register(&usennue, "Use_NNUE", ucicheck, "true", 0, 0, uciSetNnuePath);
+    ucioptions.Register(&nnueLazyUpdate, "NNUELazyUpdate", ucicheck, "false");
+    ucioptions.Register(&nnueEvalCacheSize, "NNUEEvalCache", ucispin, "0", 0, 1024, uciSetEvalCache);
     ucioptions.Register(&LogFile, "LogFile", ucistring, "", 0, 0, uciSetLogFile);
-#ifdef _WIN32
+#ifdef LARGEPAGESUPPORT
     ucioptions.Register(&allowlargepages, "Allow Large Pages", ucicheck, "true", 0, 0, uciAllowLargePages);
+#endif
+#ifdef NUMASUPPORT
+    ucioptions.Register(&NumaPolicy, "NUMA Policy", ucicombo, "Off", 0, 0, uciSetNumaPolicy, NUMAPOLICIES);
 #endif
     ucioptions.Register(&Threads, "Threads", ucispin, "1", 1, MAXTHREADS, uciSetThreads);  // order is important as the pawnhash depends on Threads > 0
     ucioptions.Register(&Hash, "Hash", ucispin, to_string(DEFAULTHASH), 1, MAXHASH, uciSetHash);
     ucioptions.Register(&moveOverhead, "Move_Overhead", ucispin, "100", 0, 5000, nullptr);
     ucioptions.Register(&MultiPV, "MultiPV", ucispin, "1", 1, MAXMULTIPV, nullptr);
+    ucioptions.Register(&threadVoting, "ThreadVoting", ucicheck, "true");
     ucioptions.Register(&ponder, "Ponder", ucicheck, "false");
     ucioptions.Register(&SyzygyPath, "SyzygyPath", ucistring, "<empty>", 0, 0, uciSetSyzygyPath);
     ucioptions.Register(&Syzygy50MoveRule, "Syzygy50MoveRule", ucicheck, "true", 0, 0, uciSetSyzygyParam);
     ucioptions.Register(&SyzygyProbeLimit, "SyzygyProbeLimit", ucispin, "7", 0, 7, uciSetSyzygyParam);
     ucioptions.Register(&BookFile, "BookFile", ucistring, "<empty>", 0, 0, uciSetBookFile);
+    ucioptions.Register(&HashFile, "Hash File", ucistring, "<empty>");
     ucioptions.Register(&BookBestMove, "BookBestMove", ucicheck, "true");
     ucioptions.Register(&BookDepth, "BookDepth", ucispin, "255", 0, 255);
     ucioptions.Register(&chess960, "UCI_Chess960", ucicheck, "false");
@@ -228,6 +289,43 @@ void engine::registerOptions()
 }
 
 
+static void createThreadAccumulators(chessposition* pos)
+{
+    pos->accumulation = NnueCurrentArch ? NnueCurrentArch->CreateAccumulationStack() : nullptr;
+    pos->psqtAccumulation = NnueCurrentArch ? NnueCurrentArch->CreatePsqtAccumulationStack() : nullptr;
+    if (NnueCurrentArch)
+        NnueCurrentArch->CreateAccumulationCache(pos);
+}
+
+
+static void freeThreadAccumulators(chessposition* pos)
+{
+    freealigned64(pos->accumulation);
+    freealigned64(pos->psqtAccumulation);
+    my_large_free(pos->accucache.accumulation);
+    my_large_free(pos->accucache.psqtaccumulation);
+    pos->accumulation = nullptr;
+    pos->psqtAccumulation = nullptr;
+    pos->accucache.accumulation = nullptr;
+    pos->accucache.psqtaccumulation = nullptr;
+}
+
+
+static void initSearchthread(searchthread* thr, int index, int sizeOfPh, int node)
+{
+    // pin to the node (or release an earlier binding) and touch the whole thread data first to allocate it there
+    numa.bindThisThread(node);
+    if (node >= 0)
+        memset((void*)thr, 0, sizeof(searchthread));
+    new (thr) searchthread();
+    thr->index = index;
+    chessposition* pos = &thr->pos;
+    pos->pwnhsh.setSize(sizeOfPh);
+    pos->mtrlhsh.init();
+    createThreadAccumulators(pos);
+}
+
+
 void engine::allocThreads()
 {
     // first cleanup the old searchthreads memory
@@ -236,43 +334,112 @@ void engine::allocThreads()
         chessposition* pos = &sthread[i].pos;
         pos->mtrlhsh.remove();
         pos->pwnhsh.remove();
-        freealigned64(pos->accumulation);
-        freealigned64(pos->psqtAccumulation);
-        freealigned64(pos->accucache.accumulation);
-        if (pos->accucache.psqtaccumulation)
-            freealigned64(pos->accucache.psqtaccumulation);
+        freeThreadAccumulators(pos);
+        pos->freeBuffers();
         pos->~chessposition();
     }
 
-    freealigned64(sthread);
+    my_large_free(sthread);
     prepared = false;
 
     oldThreads = Threads;
 
+    pool.resize(Threads);
     if (!Threads)
         return;
 
     size_t size = Threads * sizeof(searchthread);
     myassert(size % 64 == 0, nullptr, 1, size % 64);
 
-    char* buf = (char*)allocalign64(size);
-    sthread = new (buf) searchthread[Threads];
-    for (int i = 0; i < Threads; i++)
+    sthread = (searchthread*)my_large_malloc(size);
+    if (numa.active())
     {
-        sthread[i].index = i;
-        chessposition* pos = &sthread[i].pos;
-        pos->pwnhsh.setSize(sizeOfPh);
-        pos->mtrlhsh.init();
-        pos->accumulation = NnueCurrentArch ? NnueCurrentArch->CreateAccumulationStack() : nullptr;
-        pos->psqtAccumulation = NnueCurrentArch ? NnueCurrentArch->CreatePsqtAccumulationStack() : nullptr;
-        if (NnueCurrentArch)
-            NnueCurrentArch->CreateAccumulationCache(pos);
+        // initialize the thread data by the workers that will run on the node of the searchthread
+        for (int i = 0; i < Threads; i++)
+            pool.run(i, bind(initSearchthread, &sthread[i], i, sizeOfPh, numa.nodeOfThread(i)));
+        for (int i = 0; i < Threads; i++)
+            pool.wait(i);
+    }
+    else
+    {
+        for (int i = 0; i < Threads; i++)
+            initSearchthread(&sthread[i], i, sizeOfPh, -1);
     }
     prepareThreads();
     resetStats();
 }
 
 
+// Accumulator buffers of the searchthreads depend on the network dimensions; NnueSwap frees them before
+// and allocates them after switching to a network of a different size
+void engine::freeAccumulators()
+{
+    for (int i = 0; i < oldThreads; i++)
+        freeThreadAccumulators(&sthread[i].pos);
+}
+
+
+void engine::allocAccumulators()
+{
+    if (numa.active())
+    {
+        // the workers are bound to the node of their searchthread
+        for (int i = 0; i < oldThreads; i++)
+            pool.run(i, bind(createThreadAccumulators, &sthread[i].pos));
+        for (int i = 0; i < oldThreads; i++)
+            pool.wait(i);
+    }
+    else
+    {
+        for (int i = 0; i < oldThreads; i++)
+            createThreadAccumulators(&sthread[i].pos);
+    }
+}
+
+
+void engine::loadNnueInBackground()
+{
+    if (nnueLoader.joinable())
+        nnueLoader.join();
+    // a network loaded before is superseded by the new one
+    delete nnuePending;
+    nnuePending = nullptr;
+    nnueLoaderDone = false;
+    string netpath = GetNnueNetPath();
+    guiCom << "info string Loading network " + netpath + " in the background.\n";
+    nnueLoader = thread([this, netpath]() {
+        NnueNetsource* nr = new NnueNetsource();
+        nr->netpath = netpath;
+        if (nr->open())
+        {
+            nnuePending = nr;
+        }
+        else
+        {
+            delete nr;
+            guiCom << "info string Failed to open network. Keeping the current network.\n";
+        }
+        nnueLoaderDone = true;
+    });
+}
+
+
+// Called between searches only; the network loaded in the background replaces the current one
+void engine::swapPendingNnue(bool wait)
+{
+    if (!nnueLoader.joinable() || (!wait && !nnueLoaderDone))
+        return;
+    nnueLoader.join();
+    if (!nnuePending)
+        return;
+    NnueSwap(nnuePending->arch, nnuePending->nt);
+    nnuePending->arch = nullptr;
+    guiCom << "info string Network " + nnuePending->netpath + " is active now.\n";
+    delete nnuePending;
+    nnuePending = nullptr;
+}
+
+
 void engine::prepareThreads()
 {
     for (int i = 0; i < Threads; i++)
@@ -303,9 +470,17 @@ void engine::prepareThreads()
     }
     if (!prepared)
     {
-        memset(&sthread[0].pos.nodespermove, 0, sizeof(chessposition::nodespermove));
+        // the search buffers of thread #0 are zeroed when allocated at first use
+        if (sthread[0].pos.buffers)
+            memset(sthread[0].pos.nodespermove, 0, sizeof(searchbuffers::nodespermove));
         prepared = true;
     }
+    for (int i = 0; i < rootposition.rootmovelist.length; i++)
+    {
+        rootmovestat* rs = &rootmovestats[(uint16_t)rootposition.rootmovelist.move[i].code];
+        rs->nodes = 0;
+        rs->alpharaises = 0;
+    }
 }
 
 
@@ -442,6 +617,7 @@ void engine::communicate(string inputstring)
             }
             if (pendingisready)
             {
+                swapPendingNnue(true);
                 guiCom << "readyok\n";
                 pendingisready = false;
             }
@@ -504,12 +680,13 @@ void engine::communicate(string inputstring)
             case UCINEWGAME:
                 // invalidate hash and history
                 tp.clean();
+                nnuecache.clean();
                 resetStats();
                 lastbestmovescore = NOSCORE;
                 pbook.currentDepth = 0;
                 break;
             case SETOPTION:
-                if (stopLevel != ENGINETERMINATEDSEARCH)
+                if (stopLevel != ENGINETERMINATEDSEARCH && !isNnueNetpathOption(&commandargs))
                 {
                     guiCom << "info string Changing option while searching is not supported. stopLevel = " + to_string(stopLevel) + "\n";
                     break;
@@ -587,6 +764,7 @@ void engine::communicate(string inputstring)
                 pendingposition = (fen != "");
                 break;
             case GO:
+                swapPendingNnue(false);
                 if (usennue && !NnueReady)
                     break;
                 startSearchTime(false);
@@ -705,13 +883,118 @@ void engine::communicate(string inputstring)
                 sthread[0].pos.getEval<TRACE>();
                 break;
             case PERFT:
+                if (stopLevel != ENGINETERMINATEDSEARCH)
+                {
+                    guiCom << "info string Perft while searching is not supported.\n";
+                    break;
+                }
                 if (ci < cs) {
                     try { maxdepth = stoi(commandargs[ci++]); } catch (...) {}
-                    perft(max(1, maxdepth), true);
+                    int perfthashsize = 0;
+                    if (ci < cs && commandargs[ci] == "hash")
+                    {
+                        perfthashsize = Hash;
+                        if (++ci < cs)
+                            try { perfthashsize = stoi(commandargs[ci++]); } catch (...) {}
+                    }
+                    perft(max(1, maxdepth), true, max(0, perfthashsize));
+                }
+                break;
+            case SAVEHASH:
+            case LOADHASH:
+            {
+                if (stopLevel != ENGINETERMINATEDSEARCH)
+                {
+                    guiCom << "info string Saving or loading the hash while searching is not supported.\n";
+                    break;
+                }
+                string hashfile = (ci < cs ? commandargs[ci++] : HashFile);
+                if (hashfile == "<empty>" || hashfile == "")
+                {
+                    guiCom << "info string No hash file. Set option Hash File first.\n";
+                    break;
                 }
+                if (command == SAVEHASH)
+                    tp.saveToFile(hashfile);
+                else
+                    tp.loadFromFile(hashfile);
+                break;
+            }
+            case TTSTATS:
+                tp.printStats();
                 break;
             case BENCH:
             {
+                if (ci < cs && commandargs[ci] == "tt")
+                {
+                    int ttdepth = 4;
+                    if (++ci < cs)
+                        try { ttdepth = stoi(commandargs[ci++]); }
+                    catch (...) {}
+                    benchTT(max(1, ttdepth));
+                    break;
+                }
+                if (ci < cs && commandargs[ci] == "nnue")
+                {
+                    int positions = 20000;
+                    if (++ci < cs)
+                        try { positions = stoi(commandargs[ci++]); }
+                    catch (...) {}
+                    benchNnueKernels(max(1, positions));
+                    break;
+                }
+                if (ci < cs && commandargs[ci] == "nnue-batch")
+                {
+                    int positions = 100000;
+                    int batchsize = 1024;
+                    try {
+                        if (++ci < cs)
+                            positions = stoi(commandargs[ci++]);
+                        if (ci < cs)
+                            batchsize = stoi(commandargs[ci++]);
+                    }
+                    catch (...) {}
+                    benchNnueBatch(max(1, positions), max(1, batchsize));
+                    break;
+                }
+                if (ci < cs && commandargs[ci] == "evalcache")
+                {
+                    int cachedepth = 12;
+                    if (++ci < cs)
+                        try { cachedepth = stoi(commandargs[ci++]); }
+                    catch (...) {}
+                    benchEvalCache(max(1, cachedepth));
+                    break;
+                }
+                if (ci < cs && commandargs[ci] == "nnue-compare")
+                {
+                    int positions = 100000;
+                    if (++ci >= cs)
+                    {
+                        guiCom << "info string Usage: bench nnue-compare <network file> [positions]\n";
+                        break;
+                    }
+                    string netfile = commandargs[ci++];
+                    if (ci < cs)
+                        try { positions = stoi(commandargs[ci++]); }
+                    catch (...) {}
+                    benchNnueCompare(netfile, max(1, positions));
+                    break;
+                }
+                if (ci < cs && commandargs[ci] == "scaling")
+                {
+                    int maxthreads = max(2, (int)thread::hardware_concurrency());
+                    int scalingdepth = 14;
+                    try {
+                        if (++ci < cs)
+                            maxthreads = stoi(commandargs[ci++]);
+                        if (ci < cs)
+                            scalingdepth = stoi(commandargs[ci++]);
+                    }
+                    catch (...) {}
+                    benchScaling(max(1, min(MAXTHREADS, maxthreads)), max(1, scalingdepth));
+                    break;
+                }
                 maxdepth = 0;
                 mytime = 0;
                 string epdf = "";
@@ -924,7 +1207,7 @@ void engine::searchStart()
     tp.nextSearch();
 
     for (int tnum = 0; tnum < Threads; tnum++)
-        sthread[tnum].thr = thread(mainSearch<RT>, &sthread[tnum]);
+        pool.run(tnum, bind(mainSearch<RT>, &sthread[tnum]));
 }
 
 
@@ -937,11 +1220,74 @@ void engine::searchWaitStop(bool forceStop)
     if (forceStop)
         stopLevel = ENGINESTOPIMMEDIATELY;
     for (int tnum = 0; tnum < Threads; tnum++)
-        if (sthread[tnum].thr.joinable())
-            sthread[tnum].thr.join();
+        pool.wait(tnum);
     stopLevel = ENGINETERMINATEDSEARCH;
 }
 
+
+//
+// threadpool
+//
+void threadpool::idleLoop(worker* w)
+{
+    unique_lock<mutex> lock(w->mtx);
+    while (true)
+    {
+        w->cv.wait(lock, [w] { return w->busy || w->exit; });
+        if (w->exit)
+            return;
+        lock.unlock();
+        w->job();
+        lock.lock();
+        w->job = nullptr;
+        w->busy = false;
+        w->cv.notify_all();
+    }
+}
+
+
+void threadpool::resize(int n)
+{
+    while ((int)workers.size() > n)
+    {
+        worker* w = workers.back();
+        {
+            unique_lock<mutex> lock(w->mtx);
+            w->cv.wait(lock, [w] { return !w->busy; });
+            w->exit = true;
+            w->cv.notify_all();
+        }
+        w->thr.join();
+        delete w;
+        workers.pop_back();
+    }
+    while ((int)workers.size() < n)
+    {
+        worker* w = new worker();
+        w->thr = thread(idleLoop, w);
+        workers.push_back(w);
+    }
+}
+
+
+void threadpool::run(int i, function<void()> job)
+{
+    worker* w = workers[i];
+    unique_lock<mutex> lock(w->mtx);
+    w->cv.wait(lock, [w] { return !w->busy; });
+    w->job = job;
+    w->busy = true;
+    w->cv.notify_all();
+}
+
+
+void threadpool::wait(int i)
+{
+    worker* w = workers[i];
+    unique_lock<mutex> lock(w->mtx);
+    w->cv.wait(lock, [w] { return !w->busy; });
+}
+
 //
 // ucioptions interface
 //
@@ -1027,7 +1373,21 @@ void ucioptions_t::Set(string n, string v, bool force)
             *(bool*)op->enginevar = bVal;
         break;
     case ucicombo:
-        break;  // FIXME: to be implemented when Rubi gets first combo option
+    {
+        // accept any var case insensitive but store it in the spelling of the varlist
+        string lv = v;
+        transform(lv.begin(), lv.end(), lv.begin(), ::tolower);
+        istringstream vars(op->varlist);
+        string var;
+        while (vars >> var)
+        {
+            string lvar = var;
+            transform(lvar.begin(), lvar.end(), lvar.begin(), ::tolower);
+            if (lvar == lv && (bChanged = (force || var != *(string*)op->enginevar)))
+                *(string*)op->enginevar = var;
+        }
+        break;
+    }
     case ucibutton:
         bChanged = true;
         break;
@@ -1122,7 +1482,15 @@ void ucioptions_t::Print(bool bTune)
             break;
 #endif
         case ucicombo:
-            break; // FIXME: to be implemented...
+        {
+            string vars = "";
+            istringstream varlist(op->varlist);
+            string var;
+            while (varlist >> var)
+                vars += " var " + var;
+            guiCom << optionStr + "combo default " + op->def + vars + "\n";
+            break;
+        }
         default:
             break;
         }
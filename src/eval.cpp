@@ -857,7 +857,23 @@ int chessposition::getEval()
     if (NnueReady && abs(GETEGVAL(psqval)) < NnuePsqThreshold)
     {
         int frcCorrection = (en.chess960 ? getFrcCorrection() : 0);
-        score = NnueGetEval();
+        if (nnuecache.active())
+        {
+            STATISTICSINC(nnue_evalcache_probe);
+            if (nnuecache.probe(hash, &score))
+            {
+                STATISTICSINC(nnue_evalcache_hit);
+            }
+            else
+            {
+                score = NnueGetEval();
+                nnuecache.store(hash, score);
+            }
+        }
+        else
+        {
+            score = NnueGetEval();
+        }
         score += S2MSIGN(state & S2MMASK) * contempt;
         int phscaled = score * (116 + phcount) / 128;
 
@@ -1009,6 +1009,7 @@ static void gensfenthread(searchthread* thr, U64 rndseed)
     U64 psvnums = 0;
     uint32_t nmc;
     chessposition* pos = &thr->pos;
+    pos->allocBuffers();
     pos->resetStats();
     const int depthvariance = max(1, depth2 - depth + 1);
     thr->totalchunks = 0;
@@ -1047,7 +1048,7 @@ static void gensfenthread(searchthread* thr, U64 rndseed)
                 break;
             }
             pos->ply = 0;
-            movelist.length = pos->CreateMovelist<ALL>(&movelist.move[0]);
+            movelist.length = pos->CreateLegalMovelist<ALL>(&movelist.move[0]);
 
             if (movelist.length == 0)
             {
@@ -1139,47 +1140,30 @@ SKIP_SAVE:
             pos->prepareStack();
             bool chooserandom = !nmc || (ply <= random_move_maxply && random_move_flag[ply]);
 
-            while (true)
+            if (chooserandom)
             {
-                int i = 0;
-                if (chooserandom)
+                if (random_multi_pv == 0)
                 {
-                    if (random_multi_pv == 0)
-                    {
-                        i = ranval(&rnd) % movelist.length;
-                        nmc = movelist.move[i].code;
-                    }
-                    else
-                    {
-                        // random multi pv
-                        pos->getRootMoves();
-                        int cur_multi_pv = min(pos->rootmovelist.length, (ply < random_opening_ply ? 8 : random_multi_pv));
-                        int cur_multi_pv_diff = (ply < random_opening_ply ? 100 : random_multi_pv_diff);
-                        pos->rootsearch<MultiPVSearch>(SCOREBLACKWINS, SCOREWHITEWINS, random_multi_pv_depth, 1, cur_multi_pv);
-                        int s = min(pos->rootmovelist.length, cur_multi_pv);
-                        // Exclude moves with score outside of allowed margin
-                        while (cur_multi_pv_diff && pos->bestmovescore[0] > pos->bestmovescore[s - 1] + cur_multi_pv_diff)
-                            s--;
-
-                        nmc = pos->multipvtable[ranval(&rnd) % s][0];
-                    }
+                    // the move list is legal, no need to retry
+                    nmc = movelist.move[ranval(&rnd) % movelist.length].code;
                 }
-
-                bool legal = pos->playMove<false>(nmc);
-
-                if (legal)
-                    break;
-
-                movelist.move[i].code = movelist.move[--movelist.length].code;
-                if (!movelist.length)
+                else
                 {
-                    if (pos->isCheckbb) // Mate
-                        flush_psv(-S2MSIGN(pos->state & S2MMASK), thr);
-                    else if (generate_draw)
-                        flush_psv(0, thr); // Stalemate
-                    break;
+                    // random multi pv
+                    pos->getRootMoves();
+                    int cur_multi_pv = min(pos->rootmovelist.length, (ply < random_opening_ply ? 8 : random_multi_pv));
+                    int cur_multi_pv_diff = (ply < random_opening_ply ? 100 : random_multi_pv_diff);
+                    pos->rootsearch<MultiPVSearch>(SCOREBLACKWINS, SCOREWHITEWINS, random_multi_pv_depth, 1, cur_multi_pv);
+                    int s = min(pos->rootmovelist.length, cur_multi_pv);
+                    // Exclude moves with score outside of allowed margin
+                    while (cur_multi_pv_diff && pos->bestmovescore[0] > pos->bestmovescore[s - 1] + cur_multi_pv_diff)
+                        s--;
+
+                    nmc = pos->multipvtable[ranval(&rnd) % s][0];
                 }
             }
+
+            pos->playMove<false>(nmc);
         }
     }
 }
@@ -1265,7 +1249,7 @@ void gensfen(vector<string> args)
         en.sthread[tnum].chunkstate[0] = CHUNKINUSE;
         en.sthread[tnum].chunkstate[1] = CHUNKFREE;
         en.sthread[tnum].psvbuffer = (PackedSfenValue*)allocalign64(sfenchunknums * sfenchunksize * sizeof(PackedSfenValue));
-        en.sthread[tnum].thr = thread(&gensfenthread, &en.sthread[tnum], getTime() ^ zb.getRnd() );
+        pool.run(tnum, bind(&gensfenthread, &en.sthread[tnum], getTime() ^ zb.getRnd()));
     }
 
     U64 chunkswritten = 0;
@@ -1328,10 +1312,7 @@ void gensfen(vector<string> args)
     }
     gensfenstop = true;
     for (tnum = 0; tnum < en.Threads; tnum++)
-    {
-        if (en.sthread[tnum].thr.joinable())
-            en.sthread[tnum].thr.join();
-    }
+        pool.wait(tnum);
     cout << "\n\ngensfen finished.\n";
     en.MultiPV = old_multipv;
 
@@ -1371,6 +1352,7 @@ struct conversion_t {
     SfenFormat informat;
     SfenFormat cmpformat;
     int rescoreDepth;
+    int rescoreEvalBatch;
     ifstream *is;
     ifstream *cmps;
     ostream *os;
@@ -1450,6 +1432,7 @@ sfenreader::sfenreader()
     int kingfile[2] = { 4, 4 };
     memset((void*)&inbp, 0, sizeof(inbp));
     pos = (chessposition*)allocalign64(sizeof(chessposition));
+    pos->buffers = nullptr;
     pos->pwnhsh.setSize(1);
     pos->mtrlhsh.init();
     pos->initCastleRights(rookfiles, kingfile);
@@ -1472,6 +1455,7 @@ sfenreader::~sfenreader()
 {
     pos->pwnhsh.remove();
     pos->mtrlhsh.remove();
+    pos->freeBuffers();
     freealigned64(inbuffer);
     freealigned64(pos);
 }
@@ -1479,6 +1463,8 @@ sfenreader::~sfenreader()
 
 void sfenreader::init(conversion_t* cv)
 {
+    if (cv->rescoreDepth)
+        pos->allocBuffers();
     if (cv->informat == bin)
     {
         inbuffersize = sfenchunknums * sfenchunksize * sizeof(PackedSfenValue);
@@ -1664,6 +1650,46 @@ static void convertthread(searchthread* thr, conversion_t* cv)
 
     chessposition* outpos = nullptr;
 
+    // Rescoring with the static NNUE evaluation; positions are collected and evaluated in batches
+    struct pendingeval {
+        trainingdata td;
+        PackedSfenValue psv;
+        string fen;
+    };
+    NnueBatch* evalbatch = nullptr;
+    vector<pendingeval> pending;
+    vector<int> evals;
+    if (cv->rescoreEvalBatch)
+    {
+        evalbatch = new NnueBatch(cv->rescoreEvalBatch);
+        pending.reserve(cv->rescoreEvalBatch);
+        evals.resize(cv->rescoreEvalBatch);
+    }
+    auto flushEvalBatch = [cv, evalbatch, &pending, &evals]() {
+        evalbatch->evaluate(&evals[0]);
+        cv->mtout.lock();
+        for (int i = 0; i < evalbatch->size; i++)
+        {
+            if (cv->outformat == bin)
+            {
+                pending[i].psv.score = evals[i];
+                cv->os->write((char*)&pending[i].psv, sizeof(PackedSfenValue));
+            }
+            else if (cv->outformat == plain)
+            {
+                *cv->os << "fen " << pending[i].fen << endl;
+                *cv->os << "move " << moveToString(pending[i].td.move) << endl;
+                *cv->os << "score " << evals[i] << endl;
+                *cv->os << "ply " << to_string(pending[i].td.gameply) << endl;
+                *cv->os << "result " << to_string(pending[i].td.result) << endl;
+                *cv->os << "e" << endl;
+            }
+        }
+        cv->mtout.unlock();
+        evalbatch->clear();
+        pending.clear();
+    };
+
     if (cv->outformat == binpack)
     {
         outbptr = outbuffer = (char*)allocalign64(maxBinpackChunkSize + 2 * maxContinuationSize);
@@ -1716,7 +1742,33 @@ static void convertthread(searchthread* thr, conversion_t* cv)
             }
 
             chessposition* inpos = inreader->getPos();
-            if (cv->outformat == bin)
+            if (evalbatch)
+            {
+                // full refresh of the accumulator as the reader may have changed the position without updating it
+                inpos->computationState[inpos->ply][WHITE] = false;
+                inpos->computationState[inpos->ply][BLACK] = false;
+                if (!evalbatch->add(inpos))
+                {
+                    flushEvalBatch();
+                    evalbatch->add(inpos);
+                }
+                pendingeval pe;
+                pe.td = intraining;
+                if (cv->outformat == bin)
+                {
+                    pe.psv.game_result = intraining.result;
+                    pe.psv.gamePly = intraining.gameply;
+                    pe.psv.move = sfFromRubi(intraining.move);
+                    pe.psv.padding = 0xff;
+                    inpos->toSfen(&pe.psv.sfen);
+                }
+                else
+                {
+                    pe.fen = inpos->toFen();
+                }
+                pending.push_back(pe);
+            }
+            else if (cv->outformat == bin)
             {
                 PackedSfenValue psv;
                 psv.score = intraining.score;
@@ -1811,6 +1863,13 @@ static void convertthread(searchthread* thr, conversion_t* cv)
         }
     }
 
+    if (evalbatch)
+    {
+        if (evalbatch->size)
+            flushEvalBatch();
+        delete evalbatch;
+    }
+
     if (cv->outformat == binpack)
     {
         prepareNextBinpackPosition(&outbp);
@@ -1856,6 +1915,7 @@ void convert(vector<string> args)
     conv.disable_prune = 0;
     conv.skipChunks = 0;
     conv.rescoreDepth = 0;
+    conv.rescoreEvalBatch = 0;
     conv.splitChunks = 0;
     conv.numPositions = 0;
     conv.preserveChunks = 0;
@@ -1890,6 +1950,11 @@ void convert(vector<string> args)
         {
             conv.rescoreDepth = stoi(args[ci++]);
         }
+        else if (cmd == "rescore_eval" && ci < cs)
+        {
+            // batch size of the static NNUE evaluation used as new score; 0 = off
+            conv.rescoreEvalBatch = max(0, stoi(args[ci++]));
+        }
         else if (cmd == "disable_prune" && ci < cs)
         {
             conv.disable_prune = stoi(args[ci++]);
@@ -1913,6 +1978,12 @@ void convert(vector<string> args)
         }
     }
 
+    if (conv.rescoreEvalBatch && (!NnueReady || conv.rescoreDepth))
+    {
+        cout << "rescore_eval needs a loaded NNUE network and cannot be combined with rescore_depth" << endl;
+        return;
+    }
+
     conv.informat = (inputfile.find(".binpack") != string::npos ? binpack : inputfile.find(".bin") != string::npos ? bin : plain);
     conv.is = new ifstream(inputfile, conv.informat != plain ? ios::binary : ios_base::in);
     if (!conv.is)
@@ -1942,6 +2013,12 @@ void convert(vector<string> args)
         conv.outfileext = outputfile.substr(iExt);
         if (conv.outformat == no)
             conv.outformat = (conv.outfileext.find(".binpack") != string::npos ? binpack : conv.outfileext.find(".bin") != string::npos ? bin : plain);
+        if (conv.rescoreEvalBatch && conv.outformat == binpack)
+        {
+            // binpack encodes each position relative to the previous one and cannot be written deferred
+            cout << "rescore_eval supports bin and plain output only" << endl;
+            return;
+        }
 
         if (!openOutputFile(&conv))
             return;
@@ -1952,10 +2029,11 @@ void convert(vector<string> args)
     for (int tnum = 0; tnum < en.Threads; tnum++)
     {
         en.sthread[tnum].index = tnum;
-        en.sthread[tnum].thr = thread(&convertthread, &en.sthread[tnum], &conv);
+        pool.run(tnum, bind(&convertthread, &en.sthread[tnum], &conv));
     }
 
     int threadsToStop = en.Threads;
+    vector<bool> stopped(en.Threads, false);
     while (threadsToStop)
     {
         Sleep(100);
@@ -1969,9 +2047,10 @@ void convert(vector<string> args)
         }
         for (int tnum = 0; tnum < en.Threads; tnum++)
         {
-            if (en.sthread[tnum].index < 0 && en.sthread[tnum].thr.joinable())
+            if (en.sthread[tnum].index < 0 && !stopped[tnum])
             {
-                en.sthread[tnum].thr.join();
+                pool.wait(tnum);
+                stopped[tnum] = true;
                 threadsToStop--;
             }
         }
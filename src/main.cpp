@@ -46,6 +46,7 @@ void generateEpd(string egn)
         return;
     }
     chessposition *pos = &en.sthread[0].pos;
+    pos->allocBuffers();
     int pcs[16];
 
     int n = 1000;
@@ -116,53 +117,172 @@ void generateEpd(string egn)
 }
 
 
-U64 engine::perft(int depth, bool printsysteminfo)
+// Hash table for perft shared by all threads
+// The check word of an entry is the key xor the node count, so an entry torn by concurrent writes is never accepted
+class perfthash
 {
-    long long starttime = 0;
-    long long endtime = 0;
-    U64 retval = 0;
-    chessposition *rootpos = &en.sthread[0].pos;
-
-    if (printsysteminfo) {
-        starttime = getTime();
-        guiCom << "Perft for depth " + to_string(maxdepth) + (en.chess960 ? "  Chess960" : "") + "\n";
+    struct entry {
+        atomic<U64> check;
+        atomic<U64> nodes;
+    };
+    entry* table = nullptr;
+    U64 sizemask = 0;
+    static U64 key(U64 hash, int depth) { return hash ^ (depth * 0x9e3779b97f4a7c15ULL); }
+public:
+    perfthash(int sizeMb) {
+        int msb = 0;
+        U64 size = max(1ULL, ((U64)sizeMb << 20) / sizeof(entry));
+        GETMSB(msb, size);
+        size = (1ULL << msb);
+        table = (entry*)my_large_malloc((size_t)size * sizeof(entry));
+        if (!table)
+            return;
+        memset((void*)table, 0, (size_t)size * sizeof(entry));
+        sizemask = size - 1;
+    }
+    ~perfthash() {
+        if (table)
+            my_large_free(table);
+    }
+    bool active() { return table != nullptr; }
+    bool probe(U64 hash, int depth, U64* nodes) {
+        U64 k = key(hash, depth);
+        entry* e = &table[k & sizemask];
+        U64 n = e->nodes.load(memory_order_relaxed);
+        if ((e->check.load(memory_order_relaxed) ^ n) != k)
+            return false;
+        *nodes = n;
+        return true;
     }
+    void store(U64 hash, int depth, U64 nodes) {
+        U64 k = key(hash, depth);
+        entry* e = &table[k & sizemask];
+        e->check.store(k ^ nodes, memory_order_relaxed);
+        e->nodes.store(nodes, memory_order_relaxed);
+    }
+};
 
+
+// Recursive perft below the root; the hashed version needs the full move update to get the position hash
+template <bool Hashed>
+static U64 perftRecursive(chessposition* pos, int depth, perfthash* ht)
+{
     if (depth == 0)
         return 1;
 
+    U64 nodes;
+    if (Hashed && depth > 1 && ht->probe(pos->hash, depth, &nodes))
+        return nodes;
+
     chessmovelist movelist;
-    if (rootpos->isCheckbb)
-        movelist.length = rootpos->CreateEvasionMovelist(&movelist.move[0]);
-    else
-        movelist.length = rootpos->CreateMovelist<ALL>(&movelist.move[0]);
+    movelist.length = pos->CreateLegalMovelist<ALL>(&movelist.move[0]);
 
-    rootpos->prepareStack();
+    if (depth == 1)
+        // bulk counting at the leaves
+        return movelist.length;
 
+    nodes = 0;
+    pos->prepareStack();
     for (int i = 0; i < movelist.length; i++)
     {
-        if (rootpos->playMove<true>(movelist.move[i].code))
+        pos->playMove<!Hashed>(movelist.move[i].code);
+        nodes += perftRecursive<Hashed>(pos, depth - 1, ht);
+        pos->unplayMove<!Hashed>(movelist.move[i].code);
+    }
+
+    if (Hashed)
+        ht->store(pos->hash, depth, nodes);
+
+    return nodes;
+}
+
+
+// Perft of the position of thread #0; the root moves are distributed to all search threads
+U64 engine::perft(int depth, bool printsysteminfo, int hashMb)
+{
+    long long starttime = getTime();
+    chessposition *rootpos = &sthread[0].pos;
+    perfthash* ht = nullptr;
+    if (hashMb > 0)
+    {
+        ht = new perfthash(hashMb);
+        if (!ht->active())
         {
-            U64 moveperft = perft(depth - 1);
-            rootpos->unplayMove<true>(movelist.move[i].code);
-            retval += moveperft;
-            if (printsysteminfo)
-            {
-                stringstream ss;
-                ss << setw(5) << left << moveToString(movelist.move[i].code) << ": " << moveperft << "\n";
-                guiCom << ss.str();
-            }
+            delete ht;
+            ht = nullptr;
+        }
+    }
+
+    if (printsysteminfo)
+        guiCom << "Perft for depth " + to_string(depth) + (chess960 ? "  Chess960" : "") + " with " + to_string(Threads) + " threads"
+            + (ht ? " and " + to_string(hashMb) + " MByte hash" : "") + "\n";
+
+    chessmovelist movelist;
+    movelist.length = rootpos->CreateLegalMovelist<ALL>(&movelist.move[0]);
+
+    vector<U64> movenodes(movelist.length);
+    if (depth > 1 && movelist.length)
+    {
+        atomic<int> nextmove(0);
+        int numThreads = max(1, min(Threads, movelist.length));
+        // copy the root position before thread #0 starts to play moves on it
+        for (int t = 1; t < numThreads; t++)
+            memcpy((void*)&sthread[t].pos, rootpos, offsetof(chessposition, history));
+        for (int t = 0; t < numThreads; t++)
+        {
+            chessposition* pos = &sthread[t].pos;
+            pool.run(t, [pos, depth, ht, &movelist, &movenodes, &nextmove]() {
+                int i;
+                pos->prepareStack();
+                while ((i = nextmove++) < movelist.length)
+                {
+                    uint32_t mc = movelist.move[i].code;
+                    if (ht)
+                    {
+                        pos->playMove<false>(mc);
+                        movenodes[i] = perftRecursive<true>(pos, depth - 1, ht);
+                        pos->unplayMove<false>(mc);
+                    }
+                    else
+                    {
+                        pos->playMove<true>(mc);
+                        movenodes[i] = perftRecursive<false>(pos, depth - 1, ht);
+                        pos->unplayMove<true>(mc);
+                    }
+                }
+            });
+        }
+        for (int t = 0; t < numThreads; t++)
+            pool.wait(t);
+        // the positions of the threads are not prepared for a search anymore
+        prepared = false;
+    }
+    else
+    {
+        for (int i = 0; i < movelist.length; i++)
+            movenodes[i] = (depth > 0);
+    }
+
+    U64 retval = (depth > 0 ? 0 : 1);
+    for (int i = 0; i < movelist.length; i++)
+    {
+        retval += movenodes[i];
+        if (printsysteminfo)
+        {
+            stringstream ss;
+            ss << setw(5) << left << moveToString(movelist.move[i].code) << ": " << movenodes[i] << "\n";
+            guiCom << ss.str();
         }
     }
 
     if (printsysteminfo) {
-        endtime = getTime();
-        long long perftime = (long long)((endtime - starttime) * 1000.0 / frequency);
+        long long perftime = (long long)((getTime() - starttime) * 1000.0 / frequency);
         guiCom << "Total nodes: " + to_string(retval) + "\n";
         guiCom << "Time (ms):   " + to_string(perftime) + "\n";
-        guiCom << "NPS:         " + to_string((long long)(retval / (perftime / 1000.0))) + "\n";
+        guiCom << "NPS:         " + to_string((long long)(perftime ? retval * 1000 / perftime : 0)) + "\n";
     }
 
+    delete ht;
     return retval;
 }
 
@@ -337,33 +457,33 @@ static void benchTableFooder(bool bToErr, long long totaltime, long long totalno
         guiCom.switchStream();
 }
 
-void engine::bench(int constdepth, string epdfilename, int consttime, int startnum, bool openbench)
-{
-    string benchmarkfens[] = {
-        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
-        "8/k7/3p4/p2P1p2/P2P1P2/8/8/K7 w - - 0 1",
-        //"2R5/r3b1k1/p2p4/P1pPp2p/6q1/2P2N1r/4Q1P1/5RK1 w - - 0 1 ",
-        "7Q/ppp2q2/3p2k1/P2Ppr1N/1PP5/7R/5rP1/6K1 b - - 0 1",
-        "rn1qr2Q/pbppk1p1/1p2pb2/4N3/3P4/2N5/PPP3PP/R4RK1 w - - 0 1",
-        "rn1q1r2/1bp1bpk1/p3p2p/1p2N1pn/3P4/1BN1P1B1/PPQ2PPP/2R2RK1 w - - 0 1",
-        "6k1/p4qp1/1p3r1p/2pPp1p1/1PP1PnP1/2P1KR1P/1B6/7Q b - - 0 1 ",
-        "r2qk2r/1b1nbp1p/p1n1p1p1/1pp1P3/6Q1/2NPB1PN/PPP3BP/R4RK1 w kq - 0 1",
-        "8/pp3k2/2p1qp2/2P5/5P2/1R2p1rp/PP2R3/4K2Q b - - 0 1",
-        "4r1k1/1p2qrpb/p1p4p/2Pp1p2/1Q1Rn3/PNN1P1P1/1P3PP1/3R2K1 b - - 0 1",
-        "br4k1/1qrnbppp/pp1ppn2/8/NPPBP3/PN3P2/5QPP/2RR1B1K w - - 0 1",
-        "r1b1rk2/p1pq2p1/1p1b1p1p/n2P4/2P1NP2/P2B1R2/1BQ3PP/R6K w - - 0 1",
-        "r4k2/1b3ppp/p2n1P2/q1p3PQ/Np1rp3/1P1B4/P1P4P/2K1R2R w - - 0 1",
-        "N4B2/8/2K5/8/8/5k2/8/8 w - - 0 1",
-        "N7/8/2K5/2Q5/8/1N3k2/5q2/8 b - - 0 1",
-        "8/5N2/2K5/5b2/8/1N3k2/8/8 b - - 0 1",
-        "7n/BBP2P1P/8/P1PpK3/P5RR/5k2/Pn2NPN1/3Q2b1 w - d6 0 1",
-        "1r4Rk/4Nq2/7K/8/8/8/b5Q1/6R1 b - - 0 1",
-        "8/8/8/8/8/6k1/6p1/6K1 w - - 0 1",
-        "7k/7P/6K1/8/3B4/8/8/8 b - - 0 1",
-        ""
-    };
+static const string benchmarkfens[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "8/k7/3p4/p2P1p2/P2P1P2/8/8/K7 w - - 0 1",
+    //"2R5/r3b1k1/p2p4/P1pPp2p/6q1/2P2N1r/4Q1P1/5RK1 w - - 0 1 ",
+    "7Q/ppp2q2/3p2k1/P2Ppr1N/1PP5/7R/5rP1/6K1 b - - 0 1",
+    "rn1qr2Q/pbppk1p1/1p2pb2/4N3/3P4/2N5/PPP3PP/R4RK1 w - - 0 1",
+    "rn1q1r2/1bp1bpk1/p3p2p/1p2N1pn/3P4/1BN1P1B1/PPQ2PPP/2R2RK1 w - - 0 1",
+    "6k1/p4qp1/1p3r1p/2pPp1p1/1PP1PnP1/2P1KR1P/1B6/7Q b - - 0 1 ",
+    "r2qk2r/1b1nbp1p/p1n1p1p1/1pp1P3/6Q1/2NPB1PN/PPP3BP/R4RK1 w kq - 0 1",
+    "8/pp3k2/2p1qp2/2P5/5P2/1R2p1rp/PP2R3/4K2Q b - - 0 1",
+    "4r1k1/1p2qrpb/p1p4p/2Pp1p2/1Q1Rn3/PNN1P1P1/1P3PP1/3R2K1 b - - 0 1",
+    "br4k1/1qrnbppp/pp1ppn2/8/NPPBP3/PN3P2/5QPP/2RR1B1K w - - 0 1",
+    "r1b1rk2/p1pq2p1/1p1b1p1p/n2P4/2P1NP2/P2B1R2/1BQ3PP/R6K w - - 0 1",
+    "r4k2/1b3ppp/p2n1P2/q1p3PQ/Np1rp3/1P1B4/P1P4P/2K1R2R w - - 0 1",
+    "N4B2/8/2K5/8/8/5k2/8/8 w - - 0 1",
+    "N7/8/2K5/2Q5/8/1N3k2/5q2/8 b - - 0 1",
+    "8/5N2/2K5/5b2/8/1N3k2/8/8 b - - 0 1",
+    "7n/BBP2P1P/8/P1PpK3/P5RR/5k2/Pn2NPN1/3Q2b1 w - d6 0 1",
+    "1r4Rk/4Nq2/7K/8/8/8/b5Q1/6R1 b - - 0 1",
+    "8/8/8/8/8/6k1/6p1/6K1 w - - 0 1",
+    "7k/7P/6K1/8/3B4/8/8/8 b - - 0 1",
+    ""
+};
 
 
+void engine::bench(int constdepth, string epdfilename, int consttime, int startnum, bool openbench)
+{
     long long endtime;
     list<benchmarkstruct> bmlist;
 
@@ -493,6 +613,479 @@ void engine::bench(int constdepth, string epdfilename, int consttime, int startn
 
 
 
+// Measure time to depth and stability of the best move for an increasing number of threads
+void engine::benchScaling(int maxthreads, int depth)
+{
+    const int positions = 12;   // the builtin positions without the trivial endgames
+    int savedThreads = Threads;
+    vector<int> threadnums;
+    for (int t = 1; t < maxthreads; t *= 2)
+        threadnums.push_back(t);
+    threadnums.push_back(maxthreads);
+
+    vector<vector<string>> moves;
+    vector<U64> times, nodes;
+    for (int t : threadnums)
+    {
+        communicate("setoption name Threads value " + to_string(t));
+        vector<string> mv;
+        U64 time = 0, totalnodes = 0;
+        for (int i = 0; i < positions && benchmarkfens[i] != ""; i++)
+        {
+            communicate("ucinewgame");
+            communicate("position fen " + benchmarkfens[i]);
+            U64 starttime = getTime();
+            communicate("go depth " + to_string(depth));
+            searchWaitStop(false);
+            time += getTime() - starttime;
+            U64 n, tbhits;
+            getNodesAndTbhits(&n, &tbhits);
+            totalnodes += n;
+            mv.push_back(benchmove);
+        }
+        moves.push_back(mv);
+        times.push_back(time);
+        nodes.push_back(totalnodes);
+    }
+
+    guiCom << "Thread scaling with depth " + to_string(depth) + " on " + to_string(moves[0].size()) + " positions; ThreadVoting " + (threadVoting ? "on" : "off") + "\n";
+    guiCom << "Threads     Time(ms)  Speedup          Nodes          nps   Same as 1 thread   Same as " + to_string(maxthreads) + " threads\n";
+    for (size_t i = 0; i < threadnums.size(); i++)
+    {
+        int same1 = 0, samemax = 0;
+        for (size_t j = 0; j < moves[i].size(); j++)
+        {
+            same1 += (moves[i][j] == moves[0][j]);
+            samemax += (moves[i][j] == moves.back()[j]);
+        }
+        char str[256];
+        snprintf(str, 256, "%7d %12lld %8.2f %14lld %12lld %17.1f%% %17.1f%%\n", threadnums[i], (long long)(times[i] * 1000 / frequency),
+            times[i] ? (double)times[0] / times[i] : 0.0, (long long)nodes[i], (long long)(times[i] ? nodes[i] * frequency / times[i] : 0),
+            100.0 * same1 / moves[i].size(), 100.0 * samemax / moves[i].size());
+        guiCom << str;
+    }
+
+    communicate("setoption name Threads value " + to_string(savedThreads));
+}
+
+
+struct ttbenchresult
+{
+    U64 nodes;
+    U64 probes;
+    U64 hits;
+    U64 collisions;
+};
+
+// Tree walk with transposition cutoffs like perft; the payload of an entry stores the lower
+// 48 bits of the hash so false positive matches of the key can be detected
+template <class L>
+static void ttbenchWalk(chessposition* pos, transpositiontable<L>* tt, int depth, ttbenchresult* r)
+{
+    typedef typename transpositiontable<L>::entry_t entry_t;
+    U64 h = pos->hash;
+    bool found;
+    entry_t snapshot;
+
+    r->nodes++;
+    r->probes++;
+    entry_t* e = tt->probeHash(h, &found, &snapshot);
+    if (found)
+    {
+        if (e->movecode == (uint16_t)h && e->value == (int16_t)(h >> 16) && e->staticeval == (int16_t)(h >> 32))
+        {
+            r->hits++;
+            if (FIXDEPTHFROMTT(e->depth) >= depth)
+                return;
+        }
+        else {
+            r->collisions++;
+        }
+    }
+
+    if (depth > 0)
+    {
+        chessmovelist movelist;
+        if (pos->isCheckbb)
+            movelist.length = pos->CreateEvasionMovelist(&movelist.move[0]);
+        else
+            movelist.length = pos->CreateMovelist<ALL>(&movelist.move[0]);
+
+        pos->prepareStack();
+
+        for (int i = 0; i < movelist.length; i++)
+        {
+            if (pos->playMove<false>(movelist.move[i].code))
+            {
+                ttbenchWalk(pos, tt, depth - 1, r);
+                pos->unplayMove<false>(movelist.move[i].code);
+            }
+        }
+    }
+
+    tt->addHash(e, h, (int16_t)(h >> 16), (int16_t)(h >> 32), HASHEXACT, depth, (uint16_t)h);
+}
+
+template <class L>
+static void ttbenchLayout(string name, int depth, const string* fens)
+{
+    transpositiontable<L>* tt = new transpositiontable<L>();
+    tt->setSize(en.Hash);
+    tt->clean();
+    ttbenchresult r = { 0, 0, 0, 0 };
+    U64 time = 0;
+    for (int i = 0; fens[i] != ""; i++)
+    {
+        en.communicate("position fen " + fens[i]);
+        tt->nextSearch();
+        U64 starttime = getTime();
+        ttbenchWalk(&en.sthread[0].pos, tt, depth, &r);
+        time += getTime() - starttime;
+    }
+    char str[256];
+    snprintf(str, 256, "%-12s %3d  %2d bit %12lld %12lld   %6.2f%%   %8.5f%% %10lld\n", name.c_str(), L::buckets, (int)sizeof(typename L::hashupper_t) * 8,
+        (long long)(tt->size * L::buckets), r.nodes, 100.0 * r.hits / r.probes, 100.0 * r.collisions / r.probes, (long long)(r.nodes * en.frequency / max(time, 1ULL)));
+    guiCom << str;
+    delete tt;
+}
+
+// Compare the geometries of the transposition table with a tree walk that cuts at tt hits
+void engine::benchTT(int depth)
+{
+    const string fens[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r2qk2r/1b1nbp1p/p1n1p1p1/1pp1P3/6Q1/2NPB1PN/PPP3BP/R4RK1 w kq - 0 1",
+        "8/pp3k2/2p1qp2/2P5/5P2/1R2p1rp/PP2R3/4K2Q b - - 0 1",
+        ""
+    };
+    guiCom << "TT layout bench with depth " + to_string(depth) + " and Hash " + to_string(Hash) + " MByte (compiled layout uses " + to_string(TTBUCKETNUM) + " entries with " + to_string(sizeof(hashupper_t) * 8) + " bit key)\n";
+    guiCom << "Layout   Entries  Key       Entries        Nodes     Hits    Collisions        nps\n";
+    ttbenchLayout<TTLayout3x10>("3x10B/32B", depth, fens);
+    ttbenchLayout<TTLayout6x10>("6x10B/64B", depth, fens);
+    ttbenchLayout<TTLayout5x12>("5x12B/64B", depth, fens);
+}
+
+
+// Play a random legal move; returns false if there is none
+bool playRandomLegalMove(chessposition* pos, ranctx* rnd)
+{
+    chessmovelist movelist;
+    movelist.length = pos->CreateLegalMovelist<ALL>(&movelist.move[0]);
+    if (!movelist.length)
+        return false;
+    pos->prepareStack();
+    pos->playMove<false>(movelist.move[ranval(rnd) % movelist.length].code);
+    return true;
+}
+
+
+// Collect positions with random playouts from the benchmark positions
+static void collectNnueBenchPositions(chessposition* pos, int n, vector<string>* fens)
+{
+    ranctx rnd;
+    raninit(&rnd, 0x5eed);
+    for (int i = 0; (int)fens->size() < n; i++)
+    {
+        if (benchmarkfens[i] == "")
+            i = 0;
+        pos->getFromFen(benchmarkfens[i].c_str());
+        int plies = (int)(ranval(&rnd) % 40);
+        for (int p = 0; p < plies && playRandomLegalMove(pos, &rnd); p++);
+        fens->push_back(pos->toFen());
+    }
+}
+
+
+// Compare evaluations per second of single NNUE evaluation and batch evaluation of independent positions
+void engine::benchNnueBatch(int n, int batchsize)
+{
+    if (!NnueReady)
+    {
+        guiCom << "info string No NNUE network loaded.\n";
+        return;
+    }
+
+    chessposition* pos = &sthread[0].pos;
+    vector<string> fens;
+    collectNnueBenchPositions(pos, n, &fens);
+
+    NnueBatch batch(batchsize);
+    vector<int> singleevals(n), batchevals(n), layerevals(batchsize);
+    NnueCurrentArch->ResetAccumulationCache(pos);
+    auto setup = [pos](const string& fen) {
+        pos->getFromFen(fen.c_str());
+        pos->computationState[0][WHITE] = false;
+        pos->computationState[0][BLACK] = false;
+    };
+
+    // Time for setting up the positions which is included in both modes
+    U64 starttime = getTime();
+    for (int i = 0; i < n; i++)
+        setup(fens[i]);
+    U64 setuptime = getTime() - starttime;
+
+    starttime = getTime();
+    for (int i = 0; i < n; i++)
+    {
+        setup(fens[i]);
+        singleevals[i] = pos->NnueGetEval();
+    }
+    U64 singletime = getTime() - starttime;
+
+    // Batch evaluation; the network layers of each filled batch are timed separately against evaluating them one by one
+    U64 batchtime = 0, layerstime = 0, layerssingletime = 0;
+    for (int first = 0; first < n; first += batchsize)
+    {
+        const int num = min(batchsize, n - first);
+        starttime = getTime();
+        batch.clear();
+        for (int i = first; i < first + num; i++)
+        {
+            setup(fens[i]);
+            batch.add(pos);
+        }
+        U64 layersstarttime = getTime();
+        batch.evaluate(&batchevals[first]);
+        U64 endtime = getTime();
+        batchtime += endtime - starttime;
+        layerstime += endtime - layersstarttime;
+
+        starttime = getTime();
+        for (int i = 0; i < num; i++)
+            batch.evaluate(&layerevals[i], i, 1);
+        layerssingletime += getTime() - starttime;
+    }
+
+    int mismatches = 0;
+    for (int i = 0; i < n; i++)
+        mismatches += (singleevals[i] != batchevals[i]);
+
+    auto line = [this, n](string name, U64 t) {
+        char str[256];
+        snprintf(str, 256, "%-22s %10.3f %14lld\n", name.c_str(), (double)t * 1000.0 / frequency, (long long)(t ? n * frequency / t : 0));
+        guiCom << str;
+    };
+    guiCom << "NNUE batch bench with " + to_string(n) + " positions, net " + NnueCurrentArch->GetArchName() + ", batch size " + to_string(batchsize) + ", chunk size " + to_string(NNUEBATCHCHUNK) + "\n";
+    guiCom << "Mode                     Time(ms)        evals/s\n";
+    line("position setup", setuptime);
+    line("single", singletime > setuptime ? singletime - setuptime : 0);
+    line("batch", batchtime > setuptime ? batchtime - setuptime : 0);
+    line("layers only, single", layerssingletime);
+    line("layers only, batch", layerstime);
+    guiCom << "Evaluations different from single evaluation: " + to_string(mismatches) + "\n";
+}
+
+
+// Time the single NNUE kernels on random playouts of the benchmark positions
+// GB/s counts the weights, accumulators, inputs and outputs touched by a call; sparse propagation reads less than that
+void engine::benchNnueKernels(int n)
+{
+    if (!NnueReady)
+    {
+        guiCom << "info string No NNUE network loaded.\n";
+        return;
+    }
+
+    chessposition* pos = &sthread[0].pos;
+    vector<string> fens;
+    collectNnueBenchPositions(pos, n, &fens);
+
+    vector<NnueKernelTiming> timings;
+    NnueCurrentArch->BenchKernels(pos, &fens, &timings);
+
+    guiCom << "NNUE kernel bench with " + to_string(n) + " positions, net " + NnueCurrentArch->GetArchName() + "\n";
+    guiCom << "CPU-Features of binary: " + cinfo.PrintCpuFeatures(cinfo.binarySupports) + "\n";
+    guiCom << "Kernel                         Variant         Calls    ns/call      GB/s\n";
+    for (auto& t : timings)
+    {
+        char str[256];
+        snprintf(str, 256, "%-30s %-8s %12lld %10.1f %9.2f\n", t.kernel.c_str(), t.variant.c_str(), (long long)t.calls,
+            t.calls ? (double)t.time / t.calls : 0.0, t.time ? (double)t.bytes / t.time : 0.0);
+        guiCom << str;
+    }
+}
+
+
+// Compare speed and evaluations of the current network with another network of the same dimensions,
+// e.g. the compact variant with 8bit feature weights written by 'export <file> i8'
+void engine::benchNnueCompare(string netfile, int n)
+{
+    if (!NnueReady)
+    {
+        guiCom << "info string No NNUE network loaded.\n";
+        return;
+    }
+
+    NnueNetsource nr;
+    nr.netpath = netfile;
+    if (!nr.open())
+    {
+        guiCom << "info string Cannot read network " + netfile + ".\n";
+        return;
+    }
+    if (nr.arch->GetAccumulationSize() != NnueCurrentArch->GetAccumulationSize()
+        || nr.arch->GetPsqtAccumulationSize() != NnueCurrentArch->GetPsqtAccumulationSize()
+        || nr.nt != NnueReady)
+    {
+        guiCom << "info string The networks have different architectures.\n";
+        return;
+    }
+
+    chessposition* pos = &sthread[0].pos;
+    vector<string> fens;
+    collectNnueBenchPositions(pos, n, &fens);
+
+    NnueArchitecture* archs[2] = { NnueCurrentArch, nr.arch };
+    vector<int> evals[2];
+    U64 evaltime[2];
+    for (int a = 0; a < 2; a++)
+    {
+        NnueCurrentArch = archs[a];
+        NnueCurrentArch->ResetAccumulationCache(pos);
+        evals[a].resize(n);
+        U64 starttime = getTime();
+        for (int i = 0; i < n; i++)
+        {
+            pos->getFromFen(fens[i].c_str());
+            pos->computationState[0][WHITE] = false;
+            pos->computationState[0][BLACK] = false;
+            evals[a][i] = pos->NnueGetEval();
+        }
+        evaltime[a] = getTime() - starttime;
+    }
+    NnueCurrentArch = archs[0];
+    NnueCurrentArch->ResetAccumulationCache(pos);
+
+    int different = 0, maxdiff = 0;
+    U64 sumdiff = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int diff = abs(evals[0][i] - evals[1][i]);
+        different += (diff > 0);
+        maxdiff = max(maxdiff, diff);
+        sumdiff += diff;
+    }
+
+    guiCom << "NNUE compare bench with " + to_string(n) + " positions\n";
+    guiCom << "Network          Weights(MB)   Time(ms)        evals/s\n";
+    for (int a = 0; a < 2; a++)
+    {
+        char str[256];
+        snprintf(str, 256, "%-16s %11.1f %10.3f %14lld\n", archs[a]->GetArchName().c_str(), archs[a]->GetWeightsSize() / 1048576.0,
+            (double)evaltime[a] * 1000.0 / frequency, (long long)(evaltime[a] ? n * frequency / evaltime[a] : 0));
+        guiCom << str;
+    }
+    char str[256];
+    snprintf(str, 256, "Different evaluations: %d  average difference: %.3f  maximum difference: %d\n", different, (double)sumdiff / n, maxdiff);
+    guiCom << str;
+}
+
+
+// Search the benchmark positions with different sizes of the NNUE evaluation cache and compare the cost
+// of the cache accesses with the cost of a network evaluation
+void engine::benchEvalCache(int depth)
+{
+    if (!NnueReady)
+    {
+        guiCom << "info string No NNUE network loaded.\n";
+        return;
+    }
+
+    const int positions = 12;   // the builtin positions without the trivial endgames
+    const int sizes[] = { 0, 1, 4, 16, 64, 256 };
+    int savedSize = nnueEvalCacheSize;
+    char str[256];
+
+    guiCom << "NNUE evaluation cache bench with depth " + to_string(depth) + " and " + to_string(Threads) + " threads\n";
+    guiCom << "Size(MB)     Time(ms)          Nodes          nps      Hits\n";
+    for (int size : sizes)
+    {
+        communicate("setoption name NNUEEvalCache value " + to_string(size));
+#ifdef STATISTICS
+        U64 probes = statistics.nnue_evalcache_probe;
+        U64 hits = statistics.nnue_evalcache_hit;
+#endif
+        U64 time = 0, totalnodes = 0;
+        for (int i = 0; i < positions && benchmarkfens[i] != ""; i++)
+        {
+            communicate("ucinewgame");
+            communicate("position fen " + benchmarkfens[i]);
+            U64 starttime = getTime();
+            communicate("go depth " + to_string(depth));
+            searchWaitStop(false);
+            time += getTime() - starttime;
+            U64 n, tbhits;
+            getNodesAndTbhits(&n, &tbhits);
+            totalnodes += n;
+        }
+        string hitrate = "-";
+#ifdef STATISTICS
+        probes = statistics.nnue_evalcache_probe - probes;
+        hits = statistics.nnue_evalcache_hit - hits;
+        if (probes)
+        {
+            snprintf(str, 256, "%.2f%%", 100.0 * hits / probes);
+            hitrate = str;
+        }
+#endif
+        snprintf(str, 256, "%8d %12lld %14lld %12lld %9s\n", size, (long long)(time * 1000 / frequency), (long long)totalnodes,
+            (long long)(time ? totalnodes * frequency / time : 0), hitrate.c_str());
+        guiCom << str;
+    }
+    communicate("setoption name NNUEEvalCache value " + to_string(savedSize));
+
+    // Cost of a cache miss with store and of a cache hit compared to the evaluation of a position after setup
+    const int n = 100000;
+    chessposition* pos = &sthread[0].pos;
+    vector<string> fens;
+    collectNnueBenchPositions(pos, n, &fens);
+    vector<U64> hashes(n);
+    NnueCurrentArch->ResetAccumulationCache(pos);
+    U64 starttime = getTime();
+    for (int i = 0; i < n; i++)
+        pos->getFromFen(fens[i].c_str());
+    U64 setuptime = getTime() - starttime;
+    vector<int> evals(n);
+    starttime = getTime();
+    for (int i = 0; i < n; i++)
+    {
+        pos->getFromFen(fens[i].c_str());
+        pos->computationState[0][WHITE] = false;
+        pos->computationState[0][BLACK] = false;
+        evals[i] = pos->NnueGetEval();
+        hashes[i] = pos->hash;
+    }
+    U64 evaltime = getTime() - starttime;
+    evaltime = (evaltime > setuptime ? evaltime - setuptime : 0);
+
+    NnueEvalCache cache;
+    cache.setSize(16);
+    int value, found = 0;
+    starttime = getTime();
+    for (int i = 0; i < n; i++)
+        if (!cache.probe(hashes[i], &value))
+            cache.store(hashes[i], evals[i]);
+    U64 misstime = getTime() - starttime;
+    starttime = getTime();
+    for (int i = 0; i < n; i++)
+        found += cache.probe(hashes[i], &value);
+    U64 hittime = getTime() - starttime;
+    cache.remove();
+
+    double nsEval = (double)evaltime * 1e9 / frequency / n;
+    double nsMiss = (double)misstime * 1e9 / frequency / n;
+    double nsHit = (double)hittime * 1e9 / frequency / n;
+    snprintf(str, 256, "Network evaluation with accumulator refresh: %.1f ns   cache miss and store: %.1f ns   cache hit: %.1f ns (%d of %d found)\n", nsEval, nsMiss, nsHit, found, n);
+    guiCom << str;
+    if (nsEval + nsMiss > nsHit)
+    {
+        snprintf(str, 256, "The cache pays off above a hit rate of %.2f%% (higher for incrementally updated accumulators)\n", 100.0 * nsMiss / (nsEval + nsMiss - nsHit));
+        guiCom << str;
+    }
+}
+
+
 #ifdef _WIN32
 
 static void readfromengine(HANDLE pipe, enginestate *es)
@@ -864,9 +1457,18 @@ static void testengine(string epdfilename, int startnum, string engineprgs, stri
 }
 
 #endif // _WIN32
+
+#ifdef FATARCH
+const U64 fatArchSupports = compilerinfo::binarySupports;
+#endif
 } // namespace rubichess
 
+#ifdef FATARCH
+// In a fat binary main() of the dispatcher in cputest.cpp selects the best architecture and calls its archmain()
+int rubichess::archmain(int argc, char* argv[])
+#else
 int main(int argc, char* argv[])
+#endif
 {
     int startnum;
     int perfmaxdepth;
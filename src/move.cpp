@@ -85,48 +85,104 @@ void chessmovelist::print()
     printf("%s", toString().c_str());
 }
 
-// Sorting for MoveSelector; keep the move in the list
-chessmove* chessmovelist::getNextMove(int minval)
+#if !defined(USE_AVX2) && defined(USE_SSE2)
+// pmaxsd needs SSE4.1
+static inline __m128i m128_max_epi32(__m128i a, __m128i b)
 {
-    int current = -1;
-    for (int i = 0; i < length; i++)
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+#endif
+
+// Index of the first maximum in v[0..n); v has to be padded with INT_MIN to the next multiple of the vector width
+static inline int maxValueIndex(const int* v, int n)
+{
+#if defined(USE_AVX2)
+    __m256i vmax = _mm256_set1_epi32(INT_MIN);
+    for (int i = 0; i < n; i += 8)
+        vmax = _mm256_max_epi32(vmax, _mm256_loadu_si256((const __m256i*)(v + i)));
+    __m128i max128 = _mm_max_epi32(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+    max128 = _mm_max_epi32(max128, _mm_shuffle_epi32(max128, 0x4E)); //_MM_PERM_BADC
+    max128 = _mm_max_epi32(max128, _mm_shuffle_epi32(max128, 0xB1)); //_MM_PERM_CDAB
+    vmax = _mm256_broadcastd_epi32(max128);
+    for (int i = 0; ; i += 8)
     {
-        if (move[i].value > minval)
+        unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(vmax, _mm256_loadu_si256((const __m256i*)(v + i)))));
+        if (mask)
         {
-            minval = move[i].value;
-            current = i;
+            int j;
+            GETLSB32(j, mask);
+            return i + j;
         }
     }
-
-    if (current >= 0)
-        return &move[current];
-
-    return nullptr;
-}
-
-// Sorting for MoveSelector; remove it from the list
-uint32_t chessmovelist::getAndRemoveNextMove()
-{
-    int minval = INT_MIN;
-    int current = -1;
-    for (int i = 0; i < length; i++)
+#elif defined(USE_SSE2)
+    __m128i vmax = _mm_set1_epi32(INT_MIN);
+    for (int i = 0; i < n; i += 4)
+        vmax = m128_max_epi32(vmax, _mm_loadu_si128((const __m128i*)(v + i)));
+    vmax = m128_max_epi32(vmax, _mm_shuffle_epi32(vmax, 0x4E)); //_MM_PERM_BADC
+    vmax = m128_max_epi32(vmax, _mm_shuffle_epi32(vmax, 0xB1)); //_MM_PERM_CDAB
+    for (int i = 0; ; i += 4)
     {
-        if (move[i].value > minval)
+        unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(vmax, _mm_loadu_si128((const __m128i*)(v + i)))));
+        if (mask)
         {
-            minval = move[i].value;
-            current = i;
+            int j;
+            GETLSB32(j, mask);
+            return i + j;
         }
     }
+#else
+    int best = 0;
+    for (int i = 1; i < n; i++)
+        if (v[i] > v[best])
+            best = i;
+    return best;
+#endif
+}
+
 
-    if (current >= 0)
+// Next move with a value above minval; sorted moves are delivered in order, the others by maximum search
+uint32_t selectormovelist::getNextMove(int minval)
+{
+    if (current < sorted)
     {
-        int mc = move[current].code;
-        SDEBUGDO(true, lastvalue = move[current].value;)
-        move[current] = move[--length];
-        return mc;
+        if (value[current] <= minval)
+            return 0;
+        SDEBUGDO(true, lastvalue = value[current];)
+        return code[current++];
     }
 
-    return 0;
+    if (current >= length)
+        return 0;
+
+    int i = current + maxValueIndex(&value[current], length - current);
+    if (value[i] <= minval)
+        return 0;
+
+    // remove the move and keep the padding
+    uint32_t mc = code[i];
+    SDEBUGDO(true, lastvalue = value[i];)
+    length--;
+    value[i] = value[length];
+    code[i] = code[length];
+    value[length] = INT_MIN;
+    return mc;
+}
+
+// Keep the move just delivered from the sorted part for the bad captures stage
+void selectormovelist::keepAsBad()
+{
+    value[bad] = value[current - 1];
+    code[bad++] = code[current - 1];
+}
+
+uint32_t selectormovelist::getNextBadMove()
+{
+    if (badcurrent >= bad)
+        return 0;
+
+    SDEBUGDO(true, lastvalue = value[badcurrent];)
+    return code[badcurrent++];
 }
 
 
@@ -180,28 +236,72 @@ uint32_t chessposition::applyMove(string s, bool resetMstop)
 }
 
 
+template <MoveType Mt>
+inline int chessposition::getMoveValue(uint32_t mc)
+{
+    int value = 0;
+    PieceCode piece = GETPIECE(mc);
+    if (Mt == CAPTURE || (Mt == ALL && GETCAPTURE(mc)))
+    {
+        PieceCode capture = GETCAPTURE(mc);
+        value = (mvv[capture >> 1] | lva[piece >> 1]) + tacticalhst[piece >> 1][GETTO(mc)][capture >> 1];
+    }
+    if (Mt == QUIET || (Mt == ALL && !GETCAPTURE(mc)))
+    {
+        int to = GETCORRECTTO(mc);
+        value = history[piece & S2MMASK][threatSquare][GETFROM(mc)][to];
+        int pieceTo = piece * 64 + to;
+        value += (conthistptr[ply - 1][pieceTo] + conthistptr[ply - 2][pieceTo] + (conthistptr[ply - 4][pieceTo] + conthistptr[ply - 6][pieceTo]) / 2);
+    }
+    if (GETPROMOTION(mc))
+        value += mvv[GETPROMOTION(mc) >> 1] - mvv[PAWN];
+    return value;
+}
+
+
 template <MoveType Mt>
 void chessposition::evaluateMoves(chessmovelist *ml)
 {
+    for (int i = 0; i < ml->length; i++)
+        ml->move[i].value = getMoveValue<Mt>(ml->move[i].code);
+}
+
+
+// Evaluate the generated moves and copy them to the list of the MoveSelector
+// Moves with a value of at least sortlimit are sorted by insertion
+template <MoveType Mt>
+void chessposition::evaluateMoves(chessmovelist* ml, selectormovelist* sl, int sortlimit)
+{
+    int s = 0;
     for (int i = 0; i < ml->length; i++)
     {
         uint32_t mc = ml->move[i].code;
-        PieceCode piece = GETPIECE(mc);
-        if (Mt == CAPTURE || (Mt == ALL && GETCAPTURE(mc)))
+        int v = getMoveValue<Mt>(mc);
+        if (v >= sortlimit)
         {
-            PieceCode capture = GETCAPTURE(mc);
-            ml->move[i].value = (mvv[capture >> 1] | lva[piece >> 1]) + tacticalhst[piece >> 1][GETTO(mc)][capture >> 1];
+            // make room behind the sorted moves by moving the first unsorted move to the end
+            sl->value[i] = sl->value[s];
+            sl->code[i] = sl->code[s];
+            int j = s++;
+            for (; j > 0 && sl->value[j - 1] < v; j--)
+            {
+                sl->value[j] = sl->value[j - 1];
+                sl->code[j] = sl->code[j - 1];
+            }
+            sl->value[j] = v;
+            sl->code[j] = mc;
         }
-        if (Mt == QUIET || (Mt == ALL && !GETCAPTURE(mc)))
+        else
         {
-            int to = GETCORRECTTO(mc);
-            ml->move[i].value = history[piece & S2MMASK][threatSquare][GETFROM(mc)][to];
-            int pieceTo = piece * 64 + to;
-            ml->move[i].value += (conthistptr[ply - 1][pieceTo] + conthistptr[ply - 2][pieceTo] + (conthistptr[ply - 4][pieceTo] + conthistptr[ply - 6][pieceTo]) / 2);
+            sl->value[i] = v;
+            sl->code[i] = mc;
         }
-        if (GETPROMOTION(mc))
-            ml->move[i].value += mvv[GETPROMOTION(mc) >> 1] - mvv[PAWN];
     }
+    sl->length = ml->length;
+    sl->sorted = s;
+    sl->current = sl->bad = sl->badcurrent = 0;
+    for (int i = 0; i < SELECTORLISTPADDING; i++)
+        sl->value[sl->length + i] = INT_MIN;
 }
 
 
@@ -214,7 +314,7 @@ void chessposition::getRootMoves()
     else
         updateThreats<WHITE>();
     prepareStack();
-    movelist.length = CreateMovelist<ALL>(&movelist.move[0]);
+    movelist.length = CreateLegalMovelist<ALL>(&movelist.move[0]);
     evaluateMoves<ALL>(&movelist);
 
     int bestval = SCOREBLACKWINS;
@@ -225,7 +325,8 @@ void chessposition::getRootMoves()
     bool bImmediate3fold = false;
 
     bool tthit;
-    ttentry* tte = tp.probeHash(hash, &tthit);
+    ttentry ttsnapshot;
+    ttentry* tte = tp.probeHash(hash, &tthit, &ttsnapshot);
     bool bSearchmoves = (en.searchmoves.size() > 0);
 
     excludemovestack[0] = 0; // FIXME: Not very nice; is it worth to do do singular testing in root search?
@@ -524,7 +625,8 @@ void chessposition::playNullMove()
     dp->pc[0] = 0; // don't break search for updatable positions on stack
     computationState[ply][WHITE] = false;
     computationState[ply][BLACK] = false;
-    
+    computationState[ply + 1][WHITE] = false;
+    computationState[ply + 1][BLACK] = false;
 }
 
 
@@ -537,6 +639,10 @@ void chessposition::unplayNullMove()
     myassert(ply >= 0, this, 1, ply);
 }
 
+#ifdef COPYMAKE
+static_assert(offsetof(chessposition, attackedBy2) - offsetof(chessposition, piece00) == sizeof(chessboardstack), "chessboardstack doesn't match the board block of chessposition");
+#endif
+
 // Do all updates for a move played
 // LiteMode: ommit updated for several things(*) when you don't need to evaluate position
 // (*): accumulator, dirtypiece, halfmovescounter, fullmovescounter, hash, pawnhash, piececount, conthistptr, nodes, updatePins()
@@ -548,12 +654,19 @@ bool chessposition::playMove(uint32_t mc)
     int oldcastle;
     DirtyPiece* dp;
 
+#ifdef COPYMAKE
+    memcpy(&boardstack[ply], piece00, sizeof(chessboardstack));
+#endif
+
     if (!LiteMode) {
         oldcastle = (state & CASTLEMASK);
         dp = &dirtypiece[ply + 1];
         dp->dirtyNum = 0;
         computationState[ply + 1][WHITE] = false;
         computationState[ply + 1][BLACK] = false;
+        // the accumulator of the child belongs to the old position and cannot be used for backward updates
+        computationState[ply + 2][WHITE] = false;
+        computationState[ply + 2][BLACK] = false;
     }
 
     halfmovescounter++;
@@ -711,6 +824,9 @@ bool chessposition::playMove(uint32_t mc)
             }
             halfmovescounter = movestack[ply].halfmovescounter;
             kingpos[s2m] = movestack[ply].kingpos[s2m];
+#ifdef COPYMAKE
+            memcpy(piece00, &boardstack[ply], sizeof(chessboardstack));
+#else
             mailbox[from] = pfrom;
             if (promote != BLANK)
             {
@@ -742,6 +858,7 @@ bool chessposition::playMove(uint32_t mc)
             else {
                 mailbox[to] = BLANK;
             }
+#endif
             return false;
         }
 
@@ -802,6 +919,10 @@ void chessposition::unplayMove(uint32_t mc)
     // copy data from stack back to position
     memcpy(&state, &movestack[ply], sizeof(chessmovestack));
 
+#ifdef COPYMAKE
+    (void)mc;
+    memcpy(piece00, &boardstack[ply], sizeof(chessboardstack));
+#else
     // Castle has special undo
     if (ISCASTLE(mc))
     {
@@ -867,6 +988,7 @@ void chessposition::unplayMove(uint32_t mc)
             mailbox[to] = BLANK;
         }
     }
+#endif
 }
 
 
@@ -934,7 +1056,7 @@ void MoveSelector::SetPreferredMoves(chessposition *p, uint16_t hshm, uint32_t k
 
 uint32_t MoveSelector::next()
 {
-    chessmove *m;
+    uint32_t mc;
     switch (state)
     {
     case HASHMOVESTATE:
@@ -947,26 +1069,23 @@ uint32_t MoveSelector::next()
         // fall through
     case TACTICALINITSTATE:
         state++;
-        captures->length = pos->CreateMovelist<TACTICAL>(&captures->move[0]);
+        pos->selectorgenlist->length = pos->CreateMovelist<TACTICAL>(&pos->selectorgenlist->move[0]);
+        pos->evaluateMoves<CAPTURE>(pos->selectorgenlist, captures, INT_MIN);
         STATISTICSDO(numOfCaptures = captures->length);
         STATISTICSDO(if (numOfCaptures) statistics.ms_tactic_stage[PvNode][depth][numOfCaptures]++ && statistics.ms_tactic_stage[PvNode][depth][0]++);
-        pos->evaluateMoves<CAPTURE>(captures);
         // fall through
     case TACTICALSTATE:
-        while ((m = captures->getNextMove(0)))
+        while ((mc = captures->getNextMove(0)))
         {
-            SDEBUGDO(true, value = m->value;)
-            if (!pos->see(m->code, margin))
+            SDEBUGDO(true, value = captures->lastvalue;)
+            if (!pos->see(mc, margin))
             {
-                m->value |= BADTACTICALFLAG;
+                captures->keepAsBad();
             }
-            else {
-                m->value = INT_MIN;
-                if (m->code != hashmove) {
-                    STATISTICSINC(ms_tactic_moves[PvNode][depth][numOfCaptures]);
-                    STATISTICSINC(ms_tactic_moves[PvNode][depth][0]);
-                    return m->code;
-                }
+            else if (mc != hashmove) {
+                STATISTICSINC(ms_tactic_moves[PvNode][depth][numOfCaptures]);
+                STATISTICSINC(ms_tactic_moves[PvNode][depth][0]);
+                return mc;
             }
         }
         state++;
@@ -1003,14 +1122,13 @@ uint32_t MoveSelector::next()
         // fall through
     case QUIETINITSTATE:
         state++;
-        quiets->length = pos->CreateMovelist<QUIET>(&quiets->move[0]);
+        pos->selectorgenlist->length = pos->CreateMovelist<QUIET>(&pos->selectorgenlist->move[0]);
+        pos->evaluateMoves<QUIET>(pos->selectorgenlist, quiets, QUIETSORTLIMIT);
         STATISTICSDO(numOfQuiets = min(MAXSTATMOVES - 1, quiets->length));
         STATISTICSDO(if (numOfQuiets) statistics.ms_quiet_stage[PvNode][depth][numOfQuiets]++ && statistics.ms_quiet_stage[PvNode][depth][0]++);
-        pos->evaluateMoves<QUIET>(quiets);
         // fall through
     case QUIETSTATE:
-        uint32_t mc;
-        while ((mc = quiets->getAndRemoveNextMove()))
+        while ((mc = quiets->getNextMove()))
         {
             SDEBUGDO(true, value = quiets->lastvalue;);
             if (mc != hashmove
@@ -1027,16 +1145,12 @@ uint32_t MoveSelector::next()
         state++;
         // fall through
     case BADTACTICALSTATE:
-        while ((m = captures->getNextMove()))
+        if ((mc = captures->getNextBadMove()))
         {
-            SDEBUGDO(true, value = m->value;)
-            bool bBadTactical = (m->value & BADTACTICALFLAG);
-            m->value = INT_MIN;
-            if (bBadTactical) {
-                STATISTICSDO(if (m->code == hashmove) STATISTICSINC(moves_bad_hash));
-                STATISTICSINC(ms_badtactic_moves[PvNode][depth]);
-                return m->code;
-            }
+            SDEBUGDO(true, value = captures->lastvalue;)
+            STATISTICSDO(if (mc == hashmove) STATISTICSINC(moves_bad_hash));
+            STATISTICSINC(ms_badtactic_moves[PvNode][depth]);
+            return mc;
         }
         state++;
         // fall through
@@ -1044,13 +1158,13 @@ uint32_t MoveSelector::next()
         return 0;
     case EVASIONINITSTATE:
         state++;
-        captures->length = pos->CreateEvasionMovelist(&captures->move[0]);
+        pos->selectorgenlist->length = pos->CreateEvasionMovelist(&pos->selectorgenlist->move[0]);
+        pos->evaluateMoves<ALL>(pos->selectorgenlist, captures, INT_MAX);
         STATISTICSDO(numOfCaptures = captures->length);
         STATISTICSDO(if (numOfCaptures) statistics.ms_evasion_stage[PvNode][depth][numOfCaptures]++&& statistics.ms_evasion_stage[PvNode][depth][0]++);
-        pos->evaluateMoves<ALL>(captures);
         // fall through
     case EVASIONSTATE:
-        while ((mc = captures->getAndRemoveNextMove()))
+        while ((mc = captures->getNextMove()))
         {
             SDEBUGDO(true, value = captures->lastvalue;)
             STATISTICSINC(ms_evasion_moves[PvNode][depth][numOfCaptures]);
@@ -1351,11 +1465,122 @@ template <MoveType Mt> int chessposition::CreateMovelist(chessmove* mstart)
 
 
 
+// Pawn and piece moves for the legal generator
+template <MoveType Mt, Color me> inline int chessposition::CreateLegalMovelistPieces(chessmove* mstart, U64 occupiedbits, U64 targetbits)
+{
+    const int you = me ^ S2MMASK;
+    const int king = kingpos[me];
+    chessmove* m = mstart;
+
+    // pinned pieces; sliders of the opponent attacking the king through exactly one of my pieces
+    U64 pinned = 0ULL;
+    U64 pinners = isAttackedByMySlider(king, occupied00[you], you);
+    while (pinners)
+    {
+        U64 blockers = betweenMask[pullLsb(&pinners)][king] & occupied00[me];
+        if (ONEORZERO(blockers))
+            pinned |= blockers;
+    }
+
+    U64 checkmask = ~0ULL;
+    if (isCheckbb)
+    {
+        int checker;
+        GETLSB(checker, isCheckbb);
+        checkmask = isCheckbb | betweenMask[king][checker];
+    }
+
+    m += CreateMovelistPawn<Mt, me>(m);
+    m += CreateMovelistPiece<KNIGHT, me>(m, occupiedbits, targetbits & checkmask);
+    m += CreateMovelistPiece<BISHOP, me>(m, occupiedbits, targetbits & checkmask);
+    m += CreateMovelistPiece<ROOK, me>(m, occupiedbits, targetbits & checkmask);
+    m += CreateMovelistPiece<QUEEN, me>(m, occupiedbits, targetbits & checkmask);
+
+    if (pinned || isCheckbb || ((Mt & CAPTURE) && ept))
+    {
+        // remove moves of pinned pieces leaving the pin ray, pawn moves not resolving the check and illegal ep captures
+        chessmove* legal = mstart;
+        for (chessmove* pm = mstart; pm < m; pm++)
+        {
+            uint32_t mc = pm->code;
+            int from = GETFROM(mc);
+            int to = GETTO(mc);
+            bool isLegal;
+            if (ISEPCAPTURE(mc))
+            {
+                int epfield = (from & 0x38) | (to & 0x07);
+                U64 epoccupied = occupiedbits ^ BITSET(from) ^ BITSET(epfield) ^ BITSET(to);
+                isLegal = !(isCheckbb & ~BITSET(epfield) & (piece00[WPAWN | you] | piece00[WKNIGHT | you]))
+                    && !isAttackedByMySlider(king, epoccupied, you);
+            }
+            else
+            {
+                isLegal = (checkmask & BITSET(to))
+                    && (!(pinned & BITSET(from)) || (betweenMask[king][to] & BITSET(from)) || (betweenMask[king][from] & BITSET(to)));
+            }
+            if (isLegal)
+                *legal++ = *pm;
+        }
+        m = legal;
+    }
+
+    return (int)(m - mstart);
+}
+
+
+// Legal move generator
+// The king only moves to squares that are not attacked with the king removed from the board, the other pieces
+// are restricted to the check mask (capture the checker or block a slider check) and pinned pieces to their pin ray.
+// En passant captures are verified by removing both pawns from the occupancy.
+template <MoveType Mt, Color me> inline int chessposition::CreateLegalMovelist(chessmove* mstart)
+{
+    const int you = me ^ S2MMASK;
+    const int king = kingpos[me];
+    const U64 occupiedbits = (occupied00[0] | occupied00[1]);
+    U64 targetbits = 0ULL;
+    chessmove* m = mstart;
+
+    if (Mt & QUIET)
+        targetbits |= ~occupiedbits;
+    if (Mt & CAPTURE)
+        targetbits |= occupied00[you];
+
+    // moves are generated in the same order as CreateMovelist, in double check only the king can move
+    if (!MORETHANONE(isCheckbb))
+        m += CreateLegalMovelistPieces<Mt, me>(m, occupiedbits, targetbits);
+
+    U64 kingtargets = king_attacks[king] & targetbits;
+    while (kingtargets)
+    {
+        int to = pullLsb(&kingtargets);
+        if (!isAttackedBy<OCCUPIEDANDKING>(to, you) && !isAttackedByMySlider(to, occupiedbits ^ BITSET(king), you))
+            appendMoveToList(&m, king, to, WKING | me, mailbox[to]);
+    }
+
+    if (Mt & QUIET)
+        m += CreateMovelistCastle<me>(m);
+
+    return (int)(m - mstart);
+}
+
+
+template <MoveType Mt> int chessposition::CreateLegalMovelist(chessmove* mstart)
+{
+    if (state & S2MMASK)
+        return CreateLegalMovelist<Mt, BLACK>(mstart);
+    else
+        return CreateLegalMovelist<Mt, WHITE>(mstart);
+}
+
+
 // Explicit template instantiation
 // This avoids putting these definitions in header file
 template void chessposition::evaluateMoves<QUIET>(chessmovelist*);
 template void chessposition::evaluateMoves<CAPTURE>(chessmovelist*);
 template bool chessposition::playMove<true>(uint32_t);
 template void chessposition::unplayMove<true>(uint32_t);
+template bool chessposition::playMove<false>(uint32_t);
+template void chessposition::unplayMove<false>(uint32_t);
+template int chessposition::CreateLegalMovelist<ALL>(chessmove*);
 
 } // namespace rubichess
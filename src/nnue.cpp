@@ -24,6 +24,12 @@
 
 #include "RubiChess.h"
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sys/mman.h> // mmap
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 using namespace rubichess;
 
 namespace rubichess {
@@ -67,6 +73,17 @@ static constexpr int KingBucket[64] = {
   -1, -1, -1, -1,  3,  2,  1,  0
 };
 
+static constexpr int NnueKingBuckets = 32;
+
+// mirror a bitboard at the d/e file border; used to store the accumulator cache of V5 nets in the mirrored frame
+static inline U64 mirrorHorizontal(U64 bb)
+{
+    bb = ((bb >> 1) & 0x5555555555555555ULL) | ((bb & 0x5555555555555555ULL) << 1);
+    bb = ((bb >> 2) & 0x3333333333333333ULL) | ((bb & 0x3333333333333333ULL) << 2);
+    bb = ((bb >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((bb & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return bb;
+}
+
 
 //
 // Global objects
@@ -74,6 +91,44 @@ static constexpr int KingBucket[64] = {
 NnueType NnueReady = NnueDisabled;
 NnueArchitecture* NnueCurrentArch;
 
+//
+// Kernel bench ('bench nnue')
+//
+// getTime() is too coarse to time single calls of the accumulator kernels, so the kernel bench uses the steady clock
+static inline U64 NnueBenchNow()
+{
+    return (U64)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Time a number of calls of a kernel; the calls cycle through the prepared samples
+template <typename F>
+static void NnueBenchKernel(vector<NnueKernelTiming>* timings, string kernel, string variant, int calls, U64 bytes, F call)
+{
+    U64 starttime = NnueBenchNow();
+    for (int i = 0; i < calls; i++)
+        call(i);
+    timings->push_back({ kernel, variant, (U64)calls, NnueBenchNow() - starttime, calls * bytes });
+}
+
+// Time the Propagate variant that the build uses for a network layer and the native variant for comparison
+// The native variant runs first; with shuffled weights its output is wrong and gets overwritten by the Propagate variant
+template <unsigned int inputdims, unsigned int outputdims, typename L, typename I, typename O>
+static void NnueBenchLayer(vector<NnueKernelTiming>* timings, string name, int calls, L layer, I input, O output)
+{
+    typedef NnueNetworkLayer<inputdims, outputdims> layer_t;
+    const string kernel = name + " " + to_string(inputdims) + "x" + to_string(outputdims);
+    const string variant = layer_t::GetPropagateVariant();
+    const U64 bytes = layer_t::WeightsSize + inputdims * sizeof(clipped_t) + outputdims * sizeof(int32_t);
+    NnueBenchKernel(timings, kernel, "Native", calls, bytes, [&](int i) { layer(i)->PropagateNative(input(i), output(i)); });
+    if (variant != "Native")
+        NnueBenchKernel(timings, kernel, variant, calls, bytes, [&](int i) { layer(i)->Propagate(input(i), output(i)); });
+}
+
+template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t>
+static void NnueBenchAccumulator(chessposition* pos, vector<string>* fens, clipped_t* inputs, size_t stride, unsigned int inputdims,
+    int* buckets, int samples, vector<NnueKernelTiming>* timings);
+
+
 // The network architecture V1
 class NnueArchitectureV1 : public NnueArchitecture {
 public:
@@ -132,6 +187,9 @@ public:
     void WriteFeatureWeights(NnueNetsource* nr, bool leb128) {
         NnueFt.WriteFeatureWeights(nr, leb128);
     }
+    size_t WriteFeatureWeightsInt8(NnueNetsource* nr, bool leb128) {
+        return NnueFt.WriteFeatureWeightsInt8(nr, leb128);
+    }
     void WriteWeights(NnueNetsource* nr, uint32_t nethash) {
         nr->write((unsigned char*)&nethash, sizeof(uint32_t));
         LayerStack[0].NnueOut.WriteWeights(nr);
@@ -147,9 +205,9 @@ public:
     string GetArchDescription() {
         return "Features=HalfKP(Friend)[40960->256x2],Network=AffineTransform[1<-32](ClippedReLU[32](AffineTransform[32<-32](ClippedReLU[32](AffineTransform[32<-512](InputSlice[512(0:512)])))))";
     }
-    int GetEval(chessposition *pos) {
+    // Network layers from the transformed features to the evaluation, shared by single and batch evaluation
+    int Propagate(clipped_t* input) {
         struct NnueNetwork {
-            alignas(64) clipped_t input[NnueFtOutputdims];
             alignas(64) int32_t hidden1_values[NnueHidden1Dims];
             alignas(64) int32_t hidden2_values[NnueHidden2Dims];
             alignas(64) clipped_t hidden1_clipped[NnueHidden1Dims];
@@ -157,8 +215,7 @@ public:
             alignas(64) int32_t out_value;
         } network;
 
-        pos->Transform<NnueArchV1, NnueFtHalfdims, NnuePsqtBuckets>(network.input);
-        LayerStack[0].NnueHd1.Propagate(network.input, network.hidden1_values);
+        LayerStack[0].NnueHd1.Propagate(input, network.hidden1_values);
         LayerStack[0].NnueCl1.Propagate(network.hidden1_values, network.hidden1_clipped);
         LayerStack[0].NnueHd2.Propagate(network.hidden1_clipped, network.hidden2_values);
         LayerStack[0].NnueCl1.Propagate(network.hidden2_values, network.hidden2_clipped);
@@ -166,10 +223,30 @@ public:
 
         return network.out_value * sps.nnuevaluescale / 1024;
     }
+    int GetEval(chessposition *pos) {
+        alignas(64) clipped_t input[NnueFtOutputdims];
+        pos->Transform<NnueArchV1, NnueFtHalfdims, NnuePsqtBuckets>(input);
+        return Propagate(input);
+    }
     void SpeculativeEval(chessposition* pos) {
         pos->SpeculativeTransform<NnueArchV1, NnueFtHalfdims, NnuePsqtBuckets>();
     }
-    int16_t* GetFeatureWeight() {
+    struct NnueBatchEntry {
+        alignas(64) clipped_t input[NnueFtOutputdims];
+    };
+    size_t GetBatchEntrySize() {
+        return sizeof(NnueBatchEntry);
+    }
+    void BatchTransform(chessposition* pos, unsigned char* entry) {
+        pos->Transform<NnueArchV1, NnueFtHalfdims, NnuePsqtBuckets>(((NnueBatchEntry*)entry)->input);
+    }
+    void BatchPropagate(unsigned char* entries, int n, int* evals) {
+        // Single layer stack; the weights stay in cache from one position to the next
+        NnueBatchEntry* entry = (NnueBatchEntry*)entries;
+        for (int i = 0; i < n; i++)
+            evals[i] = Propagate(entry[i].input);
+    }
+    void* GetFeatureWeight() {
         return NnueFt.weight;
     }
     int16_t* GetFeatureBias() {
@@ -188,7 +265,7 @@ public:
         return nullptr;
     }
     void CreateAccumulationCache(chessposition* p) {
-        p->accucache.accumulation = (int16_t*)allocalign64(2 * 64 * NnueFtHalfdims * sizeof(int16_t));
+        p->accucache.accumulation = (int16_t*)my_large_malloc(2 * 64 * NnueFtHalfdims * sizeof(int16_t));
         p->accucache.psqtaccumulation = nullptr;
     }
     void ResetAccumulationCache(chessposition* p) {
@@ -206,6 +283,52 @@ public:
     size_t GetNetworkFilesize() {
         return networkfilesize;
     }
+    void BenchKernels(chessposition* pos, vector<string>* fens, vector<NnueKernelTiming>* timings) {
+        struct NnueBenchSample {
+            alignas(64) clipped_t input[NnueFtOutputdims];
+            alignas(64) int32_t hidden1_values[NnueHidden1Dims];
+            alignas(64) int32_t hidden2_values[NnueHidden2Dims];
+            alignas(64) clipped_t hidden1_clipped[NnueHidden1Dims];
+            alignas(64) clipped_t hidden2_clipped[NnueHidden2Dims];
+            alignas(64) int32_t out_value;
+        };
+        const int calls = (int)fens->size();
+        const int samples = min(calls, 1024);
+        NnueBenchSample* sample = (NnueBenchSample*)allocalign64(samples * sizeof(NnueBenchSample));
+        memset((void*)sample, 0, samples * sizeof(NnueBenchSample));
+        vector<int> buckets(samples);
+        NnueBenchAccumulator<NnueArchV1, NnueFtHalfdims, NnuePsqtBuckets, int16_t>(pos, fens, sample[0].input, sizeof(NnueBenchSample), NnueFtOutputdims,
+            &buckets[0], samples, timings);
+
+        NnueLayerStack* ls = &LayerStack[0];
+        auto s = [sample, samples](int i) { return &sample[i % samples]; };
+        NnueBenchLayer<NnueFtOutputdims, NnueHidden1Dims>(timings, "Hidden1", calls,
+            [ls](int) { return &ls->NnueHd1; }, [s](int i) { return s(i)->input; }, [s](int i) { return s(i)->hidden1_values; });
+        NnueBenchKernel(timings, "ClippedRelu1 " + to_string(NnueHidden1Dims), "", calls, NnueHidden1Dims * (sizeof(int32_t) + sizeof(clipped_t)),
+            [ls, s](int i) { ls->NnueCl1.Propagate(s(i)->hidden1_values, s(i)->hidden1_clipped); });
+        NnueBenchLayer<NnueHidden1Dims, NnueHidden2Dims>(timings, "Hidden2", calls,
+            [ls](int) { return &ls->NnueHd2; }, [s](int i) { return s(i)->hidden1_clipped; }, [s](int i) { return s(i)->hidden2_values; });
+        NnueBenchKernel(timings, "ClippedRelu2 " + to_string(NnueHidden2Dims), "", calls, NnueHidden2Dims * (sizeof(int32_t) + sizeof(clipped_t)),
+            [ls, s](int i) { ls->NnueCl2.Propagate(s(i)->hidden2_values, s(i)->hidden2_clipped); });
+        NnueBenchLayer<NnueHidden2Dims, 1>(timings, "Output", calls,
+            [ls](int) { return &ls->NnueOut; }, [s](int i) { return s(i)->hidden2_clipped; }, [s](int i) { return &s(i)->out_value; });
+
+        freealigned64(sample);
+    }
+    size_t GetWeightsSize() {
+        return NnueFt.WeightsSize + NnueLayerStacks * (LayerStack[0].NnueHd1.WeightsSize + LayerStack[0].NnueHd2.WeightsSize + LayerStack[0].NnueOut.WeightsSize);
+    }
+    void SetWeights(unsigned char* w) {
+        w = NnueFt.SetWeights(w);
+        for (unsigned int i = 0; i < NnueLayerStacks; i++) {
+            w = LayerStack[i].NnueHd1.SetWeights(w);
+            w = LayerStack[i].NnueHd2.SetWeights(w);
+            w = LayerStack[i].NnueOut.SetWeights(w);
+        }
+    }
+    uint32_t GetLayoutHash() {
+        return LayerStack[0].NnueHd1.GetLayoutHash() ^ (LayerStack[0].NnueHd2.GetLayoutHash() >> 1) ^ (LayerStack[0].NnueOut.GetLayoutHash() << 1);
+    }
 #ifdef STATISTICS
     void SwapInputNeurons(unsigned int i1, unsigned int i2) {
         // not supported for V1
@@ -220,7 +343,7 @@ public:
 #endif
 };
 
-template <unsigned int NnueFtOutputdims>
+template <unsigned int NnueFtOutputdims, typename ftweight_t = int16_t>
 class NnueArchitectureV5 : public NnueArchitecture {
 public:
     static constexpr unsigned int NnueFtHalfdims = NnueFtOutputdims;
@@ -234,7 +357,7 @@ public:
     static constexpr size_t networkfilesize =   // expected number of bytes remaining after architecture string
         sizeof(uint32_t)                                            // Ft hash
         + NnueFtOutputdims * sizeof(int16_t)                        // bias of feature layer
-        + NnueFtOutputdims * NnueFtInputdims * sizeof(int16_t)      // weights of feature layer
+        + NnueFtOutputdims * NnueFtInputdims * sizeof(ftweight_t)   // weights of feature layer
         + NnueFtInputdims * NnuePsqtBuckets * sizeof(int32_t)       // psqt bucket weights
         + NnueLayerStacks * (
             sizeof(uint32_t)                                        // Network layer hash
@@ -246,7 +369,7 @@ public:
             + NnueHidden2Dims * 1 * sizeof(int8_t)                  // weights of output layer
             );
 
-    NnueFeatureTransformer<NnueFtHalfdims, NnueFtInputdims, NnuePsqtBuckets> NnueFt;
+    NnueFeatureTransformer<NnueFtHalfdims, NnueFtInputdims, NnuePsqtBuckets, ftweight_t> NnueFt;
     class NnueLayerStack {
     public:
         NnueNetworkLayer<NnueFtOutputdims, NnueHidden1Dims> NnueHd1;
@@ -284,6 +407,9 @@ public:
     void WriteFeatureWeights(NnueNetsource* nr, bool leb128) {
         NnueFt.WriteFeatureWeights(nr, leb128);
     }
+    size_t WriteFeatureWeightsInt8(NnueNetsource* nr, bool leb128) {
+        return NnueFt.WriteFeatureWeightsInt8(nr, leb128);
+    }
     void WriteWeights(NnueNetsource* nr, uint32_t nethash) {
         for (unsigned int i = 0; i < NnueLayerStacks; i++) {
             nr->write((unsigned char*)&nethash, sizeof(uint32_t));
@@ -298,14 +424,14 @@ public:
         }
     }
     string GetArchName() {
-        return "V5-" + to_string(NnueFtOutputdims);
+        return "V5-" + to_string(NnueFtOutputdims) + (sizeof(ftweight_t) == 1 ? "-i8" : "");
     }
     string GetArchDescription() {
-        return "HalfKAv2_hm, " + to_string(NnueFtOutputdims) + "x16+16x32x1";
+        return "HalfKAv2_hm, " + to_string(NnueFtOutputdims) + "x16+16x32x1" + (sizeof(ftweight_t) == 1 ? ", int8 feature weights" : "");
     }
-    int GetEval(chessposition* pos) {
+    // Network layers of one layer stack from the transformed features to the evaluation, shared by single and batch evaluation
+    int Propagate(clipped_t* input, int psqt, int bucket) {
         struct NnueNetwork {
-            alignas(64) clipped_t input[NnueFtOutputdims];
             alignas(64)int32_t hidden1_values[NnueHidden1Dims];
             alignas(64)int32_t hidden2_values[NnueHidden2Dims];
             alignas(64)clipped_t hidden1_sqrclipped[MULTIPLEOFN(NnueHidden1Out, 32)];
@@ -314,9 +440,7 @@ public:
             alignas(64)int32_t out_value;
         } network;
 
-        int bucket = (POPCOUNT(pos->occupied00[WHITE] | pos->occupied00[BLACK]) - 1) / 4;
-        int psqt = pos->Transform<NnueArchV5, NnueFtHalfdims, NnuePsqtBuckets>(network.input, bucket);
-        LayerStack[bucket].NnueHd1.Propagate(network.input, network.hidden1_values);
+        LayerStack[bucket].NnueHd1.Propagate(input, network.hidden1_values);
         memset(network.hidden1_sqrclipped, 0, sizeof(network.hidden1_sqrclipped));  // FIXME: is this needed?
         LayerStack[bucket].NnueSqrCl.Propagate(network.hidden1_values, network.hidden1_sqrclipped);
         LayerStack[bucket].NnueCl1.Propagate(network.hidden1_values, network.hidden1_clipped);
@@ -335,10 +459,52 @@ public:
 
         return (psqt + positional) * sps.nnuevaluescale / 1024;
     }
+    int GetEval(chessposition* pos) {
+        alignas(64) clipped_t input[NnueFtOutputdims];
+        int bucket = (POPCOUNT(pos->occupied00[WHITE] | pos->occupied00[BLACK]) - 1) / 4;
+        int psqt = pos->Transform<NnueArchV5, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>(input, bucket);
+        return Propagate(input, psqt, bucket);
+    }
     void SpeculativeEval(chessposition* pos) {
-        pos->SpeculativeTransform<NnueArchV5, NnueFtHalfdims, NnuePsqtBuckets>();
+        pos->SpeculativeTransform<NnueArchV5, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
+    }
+    struct NnueBatchEntry {
+        alignas(64) clipped_t input[NnueFtOutputdims];
+        int psqt;
+        int bucket;
+    };
+    size_t GetBatchEntrySize() {
+        return sizeof(NnueBatchEntry);
+    }
+    void BatchTransform(chessposition* pos, unsigned char* entry) {
+        NnueBatchEntry* e = (NnueBatchEntry*)entry;
+        e->bucket = (POPCOUNT(pos->occupied00[WHITE] | pos->occupied00[BLACK]) - 1) / 4;
+        e->psqt = pos->Transform<NnueArchV5, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>(e->input, e->bucket);
+    }
+    void BatchPropagate(unsigned char* entries, int n, int* evals) {
+        // Propagate the batch in chunks of positions; inside a chunk the positions are sorted by layer stack
+        // so the weights of a layer stack stay in cache while all its positions are evaluated
+        NnueBatchEntry* entry = (NnueBatchEntry*)entries;
+        int order[NNUEBATCHCHUNK];
+        for (int chunk = 0; chunk < n; chunk += NNUEBATCHCHUNK)
+        {
+            const int chunksize = min(NNUEBATCHCHUNK, n - chunk);
+            int count[NnueLayerStacks + 1] = { 0 };
+            for (int i = 0; i < chunksize; i++)
+                count[entry[chunk + i].bucket + 1]++;
+            for (unsigned int b = 0; b < NnueLayerStacks; b++)
+                count[b + 1] += count[b];
+            for (int i = 0; i < chunksize; i++)
+                order[count[entry[chunk + i].bucket]++] = chunk + i;
+
+            for (int i = 0; i < chunksize; i++)
+            {
+                NnueBatchEntry* e = &entry[order[i]];
+                evals[order[i]] = Propagate(e->input, e->psqt, e->bucket);
+            }
+        }
     }
-    int16_t* GetFeatureWeight() {
+    void* GetFeatureWeight() {
         return NnueFt.weight;
     }
     int16_t* GetFeatureBias() {
@@ -348,7 +514,7 @@ public:
         return NnueFt.psqtWeights;
     }
     uint32_t GetFileVersion() {
-        return NNUEFILEVERSIONSFNNv5_1024;
+        return (sizeof(ftweight_t) == 1 ? NNUEFILEVERSIONSFNNv5_I8 : NNUEFILEVERSIONSFNNv5_1024);
     }
     int16_t* CreateAccumulationStack() {
         return(int16_t*) allocalign64(MAXDEPTH * 2 * NnueFtHalfdims * sizeof(int16_t));
@@ -356,16 +522,17 @@ public:
     int32_t* CreatePsqtAccumulationStack() {
         return (int32_t*)allocalign64(MAXDEPTH * 2 * NnuePsqtBuckets * sizeof(int32_t));
     }
+    // One cache entry per king bucket; king squares on the a-d files share the entry of their mirrored square
     void CreateAccumulationCache(chessposition* p) {
-        p->accucache.accumulation = (int16_t*)allocalign64(2 * 64 * NnueFtHalfdims * sizeof(int16_t));
-        p->accucache.psqtaccumulation = (int32_t*)allocalign64(2 * 64 * NnuePsqtBuckets * sizeof(int32_t));
+        p->accucache.accumulation = (int16_t*)my_large_malloc(2 * NnueKingBuckets * NnueFtHalfdims * sizeof(int16_t));
+        p->accucache.psqtaccumulation = (int32_t*)my_large_malloc(2 * NnueKingBuckets * NnuePsqtBuckets * sizeof(int32_t));
     }
     void ResetAccumulationCache(chessposition* p) {
         memset(p->accucache.piece00, 0, 2 * sizeof(p->accucache.piece00[WHITE]));
-        for (int i = 0; i < 2 * 64; i++)
+        for (int i = 0; i < 2 * NnueKingBuckets; i++)
             memcpy(p->accucache.accumulation + i * NnueFtHalfdims, NnueFt.bias, NnueFtHalfdims * sizeof(int16_t));
             
-        memset(p->accucache.psqtaccumulation, 0, 2 * 64 * NnuePsqtBuckets * sizeof(int32_t));
+        memset(p->accucache.psqtaccumulation, 0, 2 * NnueKingBuckets * NnuePsqtBuckets * sizeof(int32_t));
     }
     unsigned int GetAccumulationSize() {
         return NnueFtOutputdims;
@@ -376,6 +543,57 @@ public:
     size_t GetNetworkFilesize() {
         return networkfilesize;
     }
+    void BenchKernels(chessposition* pos, vector<string>* fens, vector<NnueKernelTiming>* timings) {
+        struct NnueBenchSample {
+            alignas(64) clipped_t input[NnueFtOutputdims];
+            alignas(64) int32_t hidden1_values[NnueHidden1Dims];
+            alignas(64) int32_t hidden2_values[NnueHidden2Dims];
+            alignas(64) clipped_t hidden1_sqrclipped[MULTIPLEOFN(NnueHidden1Out, 32)];
+            alignas(64) clipped_t hidden1_clipped[NnueHidden1Dims];
+            alignas(64) clipped_t hidden2_clipped[NnueHidden2Dims];
+            alignas(64) int32_t out_value;
+        };
+        const int calls = (int)fens->size();
+        const int samples = min(calls, 1024);
+        NnueBenchSample* sample = (NnueBenchSample*)allocalign64(samples * sizeof(NnueBenchSample));
+        memset((void*)sample, 0, samples * sizeof(NnueBenchSample));
+        vector<int> buckets(samples);
+        NnueBenchAccumulator<NnueArchV5, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>(pos, fens, sample[0].input, sizeof(NnueBenchSample), NnueFtOutputdims,
+            &buckets[0], samples, timings);
+
+        auto s = [sample, samples](int i) { return &sample[i % samples]; };
+        auto ls = [this, &buckets, samples](int i) { return &LayerStack[buckets[i % samples]]; };
+        NnueBenchLayer<NnueFtOutputdims, NnueHidden1Dims>(timings, "Hidden1", calls,
+            [ls](int i) { return &ls(i)->NnueHd1; }, [s](int i) { return s(i)->input; }, [s](int i) { return s(i)->hidden1_values; });
+        NnueBenchKernel(timings, "SqrClippedRelu1 " + to_string(NnueHidden1Dims), "", calls, NnueHidden1Dims * (sizeof(int32_t) + sizeof(clipped_t)),
+            [ls, s](int i) { ls(i)->NnueSqrCl.Propagate(s(i)->hidden1_values, s(i)->hidden1_sqrclipped); });
+        NnueBenchKernel(timings, "ClippedRelu1 " + to_string(NnueHidden1Dims), "", calls, NnueHidden1Dims * (sizeof(int32_t) + sizeof(clipped_t)),
+            [ls, s](int i) { ls(i)->NnueCl1.Propagate(s(i)->hidden1_values, s(i)->hidden1_clipped); });
+        for (int i = 0; i < samples; i++)
+            memcpy(sample[i].hidden1_sqrclipped + NnueHidden1Out, sample[i].hidden1_clipped, NnueHidden1Out * sizeof(clipped_t));
+        NnueBenchLayer<NnueHidden1Out * 2, NnueHidden2Dims>(timings, "Hidden2", calls,
+            [ls](int i) { return &ls(i)->NnueHd2; }, [s](int i) { return s(i)->hidden1_sqrclipped; }, [s](int i) { return s(i)->hidden2_values; });
+        NnueBenchKernel(timings, "ClippedRelu2 " + to_string(NnueHidden2Dims), "", calls, NnueHidden2Dims * (sizeof(int32_t) + sizeof(clipped_t)),
+            [ls, s](int i) { ls(i)->NnueCl2.Propagate(s(i)->hidden2_values, s(i)->hidden2_clipped); });
+        NnueBenchLayer<NnueHidden2Dims, 1>(timings, "Output", calls,
+            [ls](int i) { return &ls(i)->NnueOut; }, [s](int i) { return s(i)->hidden2_clipped; }, [s](int i) { return &s(i)->out_value; });
+
+        freealigned64(sample);
+    }
+    size_t GetWeightsSize() {
+        return NnueFt.WeightsSize + NnueLayerStacks * (LayerStack[0].NnueHd1.WeightsSize + LayerStack[0].NnueHd2.WeightsSize + LayerStack[0].NnueOut.WeightsSize);
+    }
+    void SetWeights(unsigned char* w) {
+        w = NnueFt.SetWeights(w);
+        for (unsigned int i = 0; i < NnueLayerStacks; i++) {
+            w = LayerStack[i].NnueHd1.SetWeights(w);
+            w = LayerStack[i].NnueHd2.SetWeights(w);
+            w = LayerStack[i].NnueOut.SetWeights(w);
+        }
+    }
+    uint32_t GetLayoutHash() {
+        return LayerStack[0].NnueHd1.GetLayoutHash() ^ (LayerStack[0].NnueHd2.GetLayoutHash() >> 1) ^ (LayerStack[0].NnueOut.GetLayoutHash() << 1);
+    }
 #ifdef STATISTICS
     void SwapInputNeurons(unsigned int i1, unsigned int i2) {
         if (i1 >= NnueFtHalfdims / 2 || i2 >= NnueFtHalfdims / 2) {
@@ -517,6 +735,7 @@ typedef __m128i bias_vec_t;
 #define vec_zero() _mm512_setzero_si512()
 #define vec_load(a) _mm512_load_si512(a)
 #define vec_store(a,b) _mm512_store_si512(a,b)
+#define vec_load_8to16(a) _mm512_cvtepi8_epi16(_mm256_load_si256((const __m256i*)(a)))
 #define vec_set_16(a) _mm512_set1_epi16(a)
 #define vec_max_16(a,b) _mm512_max_epi16(a,b)
 #define vec_min_16(a,b) _mm512_min_epi16(a,b)
@@ -551,6 +770,7 @@ typedef __m128i bias_vec_t;
 #define vec_zero() _mm256_setzero_si256()
 #define vec_load(a) _mm256_load_si256(a)
 #define vec_store(a,b) _mm256_store_si256(a,b)
+#define vec_load_8to16(a) _mm256_cvtepi8_epi16(_mm_load_si128((const __m128i*)(a)))
 #define vec_set_16(a) _mm256_set1_epi16(a)
 #define vec_max_16(a,b) _mm256_max_epi16(a,b)
 #define vec_min_16(a,b) _mm256_min_epi16(a,b)
@@ -585,6 +805,10 @@ typedef __m128i ft_vec_t, ftout_vec_t, psqt_vec_t;
 #define vec_load(a) (*(a))
 #define vec_store(a,b)  *(a)=(b)
 #define vec_set_16(a) _mm_set1_epi16(a)
+inline ft_vec_t vec_load_8to16(const int8_t* a) {
+    __m128i v = _mm_loadl_epi64((const __m128i*)a);
+    return _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+}
 #define vec_max_16(a,b) _mm_max_epi16(a,b)
 #define vec_min_16(a,b) _mm_min_epi16(a,b)
 #define vec_mul_16(a,b) _mm_mullo_epi16(a,b)
@@ -628,6 +852,7 @@ typedef int8x16_t sprsin_vec_t;
 #define vec_load(a) (*(a))
 #define vec_store(a,b)  *(a)=(b)
 #define vec_set_16(a) vdupq_n_s16(a)
+#define vec_load_8to16(a) vmovl_s8(vld1_s8(a))
 #define vec_max_16(a,b) vmaxq_s16(a,b)
 #define vec_min_16(a,b) vminq_s16(a,b)
 #define vec_mul_16(a,b) vmulq_s16(a,b)
@@ -686,6 +911,10 @@ typedef uint16x8_t vec128_t;
 
 #ifdef USE_SIMD
 #define PSQT_TILE_HEIGHT (NUM_PSQT_REGS * sizeof(psqt_vec_t) / 4)
+#define FT_WEIGHTS_PER_REG (SIMD_WIDTH / 16)
+// Feature weights are int16 or int8 for the compact V5 variant; the int8 weights are widened while loading
+inline ft_vec_t vec_load_ftweight(const int16_t* w) { return vec_load((const ft_vec_t*)w); }
+inline ft_vec_t vec_load_ftweight(const int8_t* w) { return vec_load_8to16(w); }
 #endif
 
 #if defined(USE_PROPAGATESPARSE)
@@ -713,11 +942,13 @@ alignas(64) static const array<array<uint16_t, 8>, 256> lookup_indices = []() {
 // updaterequest[0..] will contain indices of accumulators that need to be computed
 // termination of list with updaterequest[n] = -1 (n < N-1)
 // return true iff found a computed accumulator and return the array of following accumulators to compute with terminating -1
+// updaterequest[N] > ply signals a backward update from the accumulator of the last child
 template <NnueType Nt, Color c, int N> bool chessposition::GetAcccumulatorUpdateArray(int* updaterequest)
 {
     int mslast = ply;
     // A full update needs activation of all pieces (except kings for V1)
     int fullupdatecost = POPCOUNT(occupied00[WHITE] | occupied00[BLACK]) - (Nt == NnueArchV1 ? 2 : 0);
+    int forwardcost = 0;
 
     while (mslast > 0 && !computationState[mslast][c])
     {
@@ -726,12 +957,27 @@ template <NnueType Nt, Color c, int N> bool chessposition::GetAcccumulatorUpdate
         DirtyPiece* dp = &dirtypiece[mslast];
         if (dp->pc[0] == (WKING | c) || (fullupdatecost -= dp->dirtyNum + 1) < 0)
             break;
+        forwardcost += dp->dirtyNum;
         mslast--;
     }
 
+    // The accumulator of the last child searched is still valid (playMove invalidates it when this ply is entered)
+    // and reverting its dirty pieces may be cheaper than the way forward from the ancestor
+    if (ply > 0 && computationState[ply + 1][c] && dirtypiece[ply + 1].pc[0] != (WKING | c)
+        && (!computationState[mslast][c] || dirtypiece[ply + 1].dirtyNum < forwardcost))
+    {
+        updaterequest[N] = ply + 1;
+        updaterequest[0] = ply;
+        updaterequest[1] = -1;
+        return true;
+    }
+
     if (!computationState[mslast][c])
         return false;
 
+    // accumulators between the computed one and the current (except the first) are never computed
+    STATISTICSADD(nnue_accupdate_skip, max(0, ply - mslast - (N == 3 ? 2 : 1)));
+
     updaterequest[N] = mslast;
     if (N == 2) // speculative update: only update the current accumulator
     {
@@ -749,7 +995,7 @@ template <NnueType Nt, Color c, int N> bool chessposition::GetAcccumulatorUpdate
 }
 
 
-template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> void chessposition::AccumulatorUpdate()
+template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t> void chessposition::AccumulatorUpdate()
 {
     STATISTICSINC(nnue_accupdate_all);
 
@@ -760,13 +1006,13 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
     }
 
     if (GetAcccumulatorUpdateArray<Nt, c, 3>(updatechain))
-        AccumulatorIncrementalUpdate< Nt, c, NnueFtHalfdims, NnuePsqtBuckets, 3>(updatechain);
+        AccumulatorIncrementalUpdate<Nt, c, NnueFtHalfdims, NnuePsqtBuckets, 3, ftweight_t>(updatechain);
     else
-        AccumulatorRefresh< Nt, c, NnueFtHalfdims, NnuePsqtBuckets>();
+        AccumulatorRefresh<Nt, c, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
 }
 
 
-template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> void chessposition::AccumulatorSpeculativeUpdate()
+template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t> void chessposition::AccumulatorSpeculativeUpdate()
 {
     STATISTICSINC(nnue_accupdate_all);
     STATISTICSINC(nnue_accupdate_spec);
@@ -778,13 +1024,13 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
     }
 
     if (GetAcccumulatorUpdateArray<Nt, c, 2>(updatechain))
-        AccumulatorIncrementalUpdate< Nt, c, NnueFtHalfdims, NnuePsqtBuckets, 2>(updatechain);
+        AccumulatorIncrementalUpdate<Nt, c, NnueFtHalfdims, NnuePsqtBuckets, 2, ftweight_t>(updatechain);
     else
-        AccumulatorRefresh< Nt, c, NnueFtHalfdims, NnuePsqtBuckets>();
+        AccumulatorRefresh<Nt, c, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
 }
 
 
-template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, int N> void chessposition::AccumulatorIncrementalUpdate(int* updaterequest)
+template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, int N, typename ftweight_t> int chessposition::AccumulatorIncrementalUpdate(int* updaterequest)
 {
 #ifdef NNUEDEBUG
     cout << "\nAccumulatorIncrementalUpdate\n";
@@ -796,7 +1042,14 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
     int nextchangedply = lastcomputedply + 1;
     int nextcomputeply;
     int chainindex = 0;
-    while ((nextcomputeply = updaterequest[chainindex]) >= 0) {
+    if (lastcomputedply > ply) {
+        // backward update: revert the dirty pieces of the child
+        STATISTICSINC(nnue_accupdate_back);
+        removedIndices[0].size = addedIndices[0].size = 0;
+        computationState[ply][c] = true;
+        HalfkpAppendChangedIndices<Nt, c>(&dirtypiece[lastcomputedply], &removedIndices[0], &addedIndices[0]);
+    }
+    else while ((nextcomputeply = updaterequest[chainindex]) >= 0) {
         removedIndices[chainindex].size = addedIndices[chainindex].size = 0;
         computationState[nextcomputeply][c] = true;
         while (nextchangedply <= nextcomputeply) {
@@ -806,7 +1059,7 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
         chainindex++;
     }
 
-    int16_t* weight = NnueCurrentArch->GetFeatureWeight();
+    ftweight_t* weight = (ftweight_t*)NnueCurrentArch->GetFeatureWeight();
     int32_t* psqtweight = NnueCurrentArch->GetFeaturePsqtWeight();
 
 #ifdef USE_SIMD
@@ -820,20 +1073,18 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
     {
         ft_vec_t* accTileIn = (ft_vec_t*)(accumulation + (lastcomputedply * 2 + c) * NnueFtHalfdims);
         ft_vec_t* accTileOut = (ft_vec_t*)(accumulation + (updaterequest[0] * 2 + c) * NnueFtHalfdims);
-        const unsigned int offR0 = NnueFtHalfdims * removedIndices[0].values[0];
-        ft_vec_t* colR0 = (ft_vec_t*)(weight + offR0);
-        const unsigned int offA0 = NnueFtHalfdims * addedIndices[0].values[0];
-        ft_vec_t* colA0 = (ft_vec_t*)(weight + offA0);
+        const ftweight_t* colR0 = weight + NnueFtHalfdims * removedIndices[0].values[0];
+        const ftweight_t* colA0 = weight + NnueFtHalfdims * addedIndices[0].values[0];
         if (removedIndices[0].size == 1)
         {
             for (unsigned int k = 0; k < NnueFtHalfdims * sizeof(int16_t) / sizeof(ft_vec_t); k++)
-                accTileOut[k] = vec_add_16(vec_sub_16(accTileIn[k], colR0[k]), colA0[k]);
+                accTileOut[k] = vec_add_16(vec_sub_16(accTileIn[k], vec_load_ftweight(colR0 + k * FT_WEIGHTS_PER_REG)), vec_load_ftweight(colA0 + k * FT_WEIGHTS_PER_REG));
         }
         else {
-            const unsigned int offR1 = NnueFtHalfdims * removedIndices[0].values[1];
-            ft_vec_t* colR1 = (ft_vec_t*)(weight + offR1);
+            const ftweight_t* colR1 = weight + NnueFtHalfdims * removedIndices[0].values[1];
             for (unsigned int k = 0; k < NnueFtHalfdims * sizeof(int16_t) / sizeof(ft_vec_t); k++)
-                accTileOut[k] = vec_sub_16(vec_add_16(accTileIn[k], colA0[k]), vec_add_16(colR0[k], colR1[k]));
+                accTileOut[k] = vec_sub_16(vec_add_16(accTileIn[k], vec_load_ftweight(colA0 + k * FT_WEIGHTS_PER_REG)),
+                    vec_add_16(vec_load_ftweight(colR0 + k * FT_WEIGHTS_PER_REG), vec_load_ftweight(colR1 + k * FT_WEIGHTS_PER_REG)));
         }
 
         psqt_vec_t* accTilePsqtIn = (psqt_vec_t*)(psqtAccumulation + (lastcomputedply * 2 + c) * NnuePsqtBuckets);
@@ -867,9 +1118,9 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
                 {
                     unsigned int index = removedIndices[l].values[k];
                     const unsigned int offset = NnueFtHalfdims * index + i * tileHeight;
-                    ft_vec_t* column = (ft_vec_t*)(weight + offset);
+                    const ftweight_t* column = weight + offset;
                     for (unsigned int j = 0; j < numRegs; j++)
-                        acc[j] = vec_sub_16(acc[j], column[j]);
+                        acc[j] = vec_sub_16(acc[j], vec_load_ftweight(column + j * FT_WEIGHTS_PER_REG));
                 }
 
                 // Difference calculation for the activated features
@@ -877,9 +1128,9 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
                 {
                     unsigned int index = addedIndices[l].values[k];
                     const unsigned int offset = NnueFtHalfdims * index + i * tileHeight;
-                    ft_vec_t* column = (ft_vec_t*)(weight + offset);
+                    const ftweight_t* column = weight + offset;
                     for (unsigned int j = 0; j < numRegs; j++)
-                        acc[j] = vec_add_16(acc[j], column[j]);
+                        acc[j] = vec_add_16(acc[j], vec_load_ftweight(column + j * FT_WEIGHTS_PER_REG));
                 }
 
                 accTile = (ft_vec_t*)(accumulation + (updaterequest[l] * 2 + c) * NnueFtHalfdims + i * tileHeight);
@@ -963,10 +1214,16 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
 #ifdef NNUEDEBUG
     AccumulatorDebug<Nt, c, NnueFtHalfdims, NnuePsqtBuckets>();
 #endif
+
+    // number of features added or removed along the update chain
+    int features = 0;
+    for (int l = 0; l < N - 1 && updaterequest[l] >= 0; l++)
+        features += removedIndices[l].size + addedIndices[l].size;
+    return features;
 }
 
 
-template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets> void chessposition::AccumulatorRefresh()
+template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t> int chessposition::AccumulatorRefresh()
 {
 #ifdef NNUEDEBUG
     cout << "AccumulatorRefresh\n";
@@ -977,37 +1234,43 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
 
     const int ksq = kingpos[c];
     const int oksq = (Nt == NnueArchV1 ? ORIENT(c, ksq) : HMORIENT(c, ksq, ksq));
-    U64* cachedpiece00 = (U64*) & (accucache.piece00[c][ksq]);
-    int16_t* cacheaccumulation = accucache.accumulation + (c * 64 + ksq) * NnueFtHalfdims;
-    int32_t* cachepsqtaccumulation = accucache.psqtaccumulation + (c * 64 + ksq) * NnuePsqtBuckets;
+    // V1 uses one cache entry per king square, V5 one per king bucket with the bitboards stored in the mirrored frame
+    const int entry = (Nt == NnueArchV1 ? ksq : KingBucket[oksq]);
+    const int entries = (Nt == NnueArchV1 ? 64 : NnueKingBuckets);
+    const bool mirrored = (Nt != NnueArchV1 && FILE(ksq) < 4);
+    U64* cachedpiece00 = (U64*) & (accucache.piece00[c][entry]);
+    int16_t* cacheaccumulation = accucache.accumulation + (c * entries + entry) * NnueFtHalfdims;
+    int32_t* cachepsqtaccumulation = accucache.psqtaccumulation + (c * entries + entry) * NnuePsqtBuckets;
     unsigned int index;
     NnueIndexList addedIndices, removedIndices;
     addedIndices.size = removedIndices.size = 0;
     for (int p = WPAWN; p <= (Nt == NnueArchV1 ? BQUEEN : BKING); p++)
     {
-        U64 addedbb = piece00[p] & ~cachedpiece00[p];
+        const U64 bb = (mirrored ? mirrorHorizontal(piece00[p]) : piece00[p]);
+        U64 addedbb = bb & ~cachedpiece00[p];
         while (addedbb)
         {
             index = pullLsb(&addedbb);
             if (Nt == NnueArchV1)
                 addedIndices.values[addedIndices.size++] = ORIENT(c, index) + PieceToIndex[c][p] + PS_KPEND * oksq;
             else
-                addedIndices.values[addedIndices.size++] = HMORIENT(c, index, ksq) + PieceToIndex[c][p] + PS_KAEND * KingBucket[oksq];
+                addedIndices.values[addedIndices.size++] = (index ^ (c * 56)) + PieceToIndex[c][p] + PS_KAEND * entry;
         }
-        U64 removedbb = ~piece00[p] & cachedpiece00[p];
+        U64 removedbb = ~bb & cachedpiece00[p];
         while (removedbb)
         {
             index = pullLsb(&removedbb);
             if (Nt == NnueArchV1)
                 removedIndices.values[removedIndices.size++] = ORIENT(c, index) + PieceToIndex[c][p] + PS_KPEND * oksq;
             else
-                removedIndices.values[removedIndices.size++] = HMORIENT(c, index, ksq) + PieceToIndex[c][p] + PS_KAEND * KingBucket[oksq];
+                removedIndices.values[removedIndices.size++] = (index ^ (c * 56)) + PieceToIndex[c][p] + PS_KAEND * entry;
         }
+        cachedpiece00[p] = bb;
     }
 
-    memcpy(cachedpiece00, piece00, sizeof(piece00));
+    STATISTICSADD(nnue_refresh_features, addedIndices.size + removedIndices.size);
 
-    int16_t* weight = NnueCurrentArch->GetFeatureWeight();
+    ftweight_t* weight = (ftweight_t*)NnueCurrentArch->GetFeatureWeight();
     int32_t* psqtweight = NnueCurrentArch->GetFeaturePsqtWeight();
 
 #ifdef USE_SIMD
@@ -1027,9 +1290,9 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
         {
             index = removedIndices.values[k];
             const unsigned int offset = NnueFtHalfdims * index + i * tileHeight;
-            ft_vec_t* column = (ft_vec_t*)(weight + offset);
+            const ftweight_t* column = weight + offset;
             for (unsigned int j = 0; j < numRegs; j++)
-                acc[j] = vec_sub_16(acc[j], column[j]);
+                acc[j] = vec_sub_16(acc[j], vec_load_ftweight(column + j * FT_WEIGHTS_PER_REG));
         }
 
         // Difference calculation for the activated features
@@ -1037,9 +1300,9 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
         {
             index = addedIndices.values[k];
             const unsigned int offset = NnueFtHalfdims * index + i * tileHeight;
-            ft_vec_t* column = (ft_vec_t*)(weight + offset);
+            const ftweight_t* column = weight + offset;
             for (unsigned int j = 0; j < numRegs; j++)
-                acc[j] = vec_add_16(acc[j], column[j]);
+                acc[j] = vec_add_16(acc[j], vec_load_ftweight(column + j * FT_WEIGHTS_PER_REG));
         }
 
         for (unsigned int j = 0; j < numRegs; j++)
@@ -1112,6 +1375,8 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
 #ifdef NNUEDEBUG
     AccumulatorDebug<Nt, c, NnueFtHalfdims, NnuePsqtBuckets>();
 #endif
+
+    return addedIndices.size + removedIndices.size;
 }
 
 
@@ -1141,19 +1406,19 @@ template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePs
 #endif
 
 
-template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets>
+template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t>
 void chessposition::SpeculativeTransform()
 {
-    AccumulatorSpeculativeUpdate<Nt, WHITE, NnueFtHalfdims, NnuePsqtBuckets>();
-    AccumulatorSpeculativeUpdate<Nt, BLACK, NnueFtHalfdims, NnuePsqtBuckets>();
+    AccumulatorSpeculativeUpdate<Nt, WHITE, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
+    AccumulatorSpeculativeUpdate<Nt, BLACK, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
 }
 
 
-template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets>
+template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t>
 int chessposition::Transform(clipped_t *output, int bucket)
 {
-    AccumulatorUpdate <Nt, WHITE, NnueFtHalfdims, NnuePsqtBuckets>();
-    AccumulatorUpdate <Nt, BLACK, NnueFtHalfdims, NnuePsqtBuckets>();
+    AccumulatorUpdate <Nt, WHITE, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
+    AccumulatorUpdate <Nt, BLACK, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
 
     int16_t* acm = accumulation + ply * 2 * NnueFtHalfdims;
     int32_t* psqtacm = psqtAccumulation + ply * 2 * NnuePsqtBuckets;
@@ -1247,6 +1512,91 @@ int chessposition::Transform(clipped_t *output, int bucket)
 }
 
 
+// Time an incremental update of one perspective after a move; king moves of HalfKA nets need a refresh which is not timed here
+template <NnueType Nt, Color c, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t>
+static void NnueBenchIncrementalUpdate(chessposition* pos, NnueKernelTiming* timing, U64 overhead)
+{
+    constexpr U64 accbytes = NnueFtHalfdims * sizeof(int16_t) + NnuePsqtBuckets * sizeof(int32_t);
+    constexpr U64 featurebytes = NnueFtHalfdims * sizeof(ftweight_t) + NnuePsqtBuckets * sizeof(int32_t);
+    int updatechain[4];
+    if (!pos->GetAcccumulatorUpdateArray<Nt, c, 3>(updatechain))
+    {
+        pos->AccumulatorRefresh<Nt, c, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
+        return;
+    }
+    const int targets = (updatechain[1] >= 0 ? 2 : 1);
+    U64 starttime = NnueBenchNow();
+    int features = pos->AccumulatorIncrementalUpdate<Nt, c, NnueFtHalfdims, NnuePsqtBuckets, 3, ftweight_t>(updatechain);
+    U64 t = NnueBenchNow() - starttime;
+    timing->time += (t > overhead ? t - overhead : 0);
+    timing->calls++;
+    timing->bytes += features * featurebytes + (1 + targets) * accbytes;
+}
+
+
+// Time the accumulator kernels and the transformer on the positions and a few random moves following each of them
+// The transformed inputs of the first positions are stored as samples for the network layers
+template <NnueType Nt, unsigned int NnueFtHalfdims, unsigned int NnuePsqtBuckets, typename ftweight_t>
+static void NnueBenchAccumulator(chessposition* pos, vector<string>* fens, clipped_t* inputs, size_t stride, unsigned int inputdims,
+    int* buckets, int samples, vector<NnueKernelTiming>* timings)
+{
+    constexpr U64 accbytes = NnueFtHalfdims * sizeof(int16_t) + NnuePsqtBuckets * sizeof(int32_t);
+    constexpr U64 featurebytes = NnueFtHalfdims * sizeof(ftweight_t) + NnuePsqtBuckets * sizeof(int32_t);
+    NnueKernelTiming refresh = { "AccumulatorRefresh", "", 0, 0, 0 };
+    NnueKernelTiming incremental = { "AccumulatorIncrementalUpdate", "", 0, 0, 0 };
+    NnueKernelTiming transform = { "Transform", "", 0, 0, 0 };
+    clipped_t* scratch = (clipped_t*)allocalign64(inputdims * sizeof(clipped_t));
+
+    // reading the clock is not free; its cost is subtracted from every timed call
+    const int clockreads = 10000;
+    U64 overhead = NnueBenchNow();
+    for (int i = 0; i < clockreads; i++)
+        NnueBenchNow();
+    overhead = (NnueBenchNow() - overhead) / (clockreads + 1);
+
+    ranctx rnd;
+    raninit(&rnd, 0x5eed);
+    NnueCurrentArch->ResetAccumulationCache(pos);
+    for (size_t i = 0; i < fens->size(); i++)
+    {
+        pos->getFromFen((*fens)[i].c_str());
+        memset(pos->computationState, 0, sizeof(pos->computationState));
+
+        U64 starttime = NnueBenchNow();
+        int features = pos->AccumulatorRefresh<Nt, WHITE, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
+        features += pos->AccumulatorRefresh<Nt, BLACK, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>();
+        U64 t = NnueBenchNow() - starttime;
+        refresh.time += (t > 2 * overhead ? t - 2 * overhead : 0);
+        refresh.calls += 2;
+        // the cache entry is read and written and copied to the accumulator
+        refresh.bytes += features * featurebytes + 2 * 3 * accbytes;
+
+        for (int p = 0; p < 4 && playRandomLegalMove(pos, &rnd); p++)
+        {
+            NnueBenchIncrementalUpdate<Nt, WHITE, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>(pos, &incremental, overhead);
+            NnueBenchIncrementalUpdate<Nt, BLACK, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>(pos, &incremental, overhead);
+        }
+
+        // the accumulators are up to date, so this only times the transformation to the network input
+        int bucket = (Nt == NnueArchV5 ? (POPCOUNT(pos->occupied00[WHITE] | pos->occupied00[BLACK]) - 1) / 4 : 0);
+        clipped_t* output = ((int)i < samples ? (clipped_t*)((unsigned char*)inputs + i * stride) : scratch);
+        starttime = NnueBenchNow();
+        pos->Transform<Nt, NnueFtHalfdims, NnuePsqtBuckets, ftweight_t>(output, bucket);
+        t = NnueBenchNow() - starttime;
+        transform.time += (t > overhead ? t - overhead : 0);
+        transform.calls++;
+        transform.bytes += 2 * accbytes + inputdims * sizeof(clipped_t);
+        if ((int)i < samples)
+            buckets[i] = bucket;
+    }
+
+    NnueCurrentArch->ResetAccumulationCache(pos);
+    freealigned64(scratch);
+    timings->push_back(refresh);
+    timings->push_back(incremental);
+    timings->push_back(transform);
+}
+
 int chessposition::NnueGetEval()
 {
     return NnueCurrentArch->GetEval(this);
@@ -1255,10 +1605,88 @@ int chessposition::NnueGetEval()
 
 void chessposition::NnueSpeculativeEval()
 {
+    if (!NnueReady)
+        return;
+
+    // In lazy mode the accumulator is only touched when an evaluation is needed
+    if (en.nnueLazyUpdate) {
+        STATISTICSINC(nnue_accupdate_lazy);
+        return;
+    }
+
     NnueCurrentArch->SpeculativeEval(this);
 }
 
 
+//
+// Evaluation cache
+//
+
+NnueEvalCache nnuecache;
+
+void NnueEvalCache::setSize(int sizeMb)
+{
+    remove();
+    if (sizeMb <= 0)
+        return;
+
+    int msb = 0;
+    U64 size = ((U64)sizeMb << 20) / sizeof(U64);
+    GETMSB(msb, size);
+    size = (1ULL << msb);
+    table = (atomic<U64>*)my_large_malloc((size_t)size * sizeof(U64));
+    if (!table)
+        return;
+    sizemask = size - 1;
+    clean();
+}
+
+void NnueEvalCache::remove()
+{
+    if (table)
+        my_large_free(table);
+    table = nullptr;
+    sizemask = 0;
+}
+
+void NnueEvalCache::clean()
+{
+    if (table)
+        memset((void*)table, 0, (size_t)(sizemask + 1) * sizeof(U64));
+}
+
+
+//
+// Batch evaluation
+//
+
+NnueBatch::NnueBatch(int n)
+{
+    capacity = n;
+    size = 0;
+    entrysize = NnueCurrentArch->GetBatchEntrySize();
+    entries = (unsigned char*)allocalign64(capacity * entrysize);
+}
+
+NnueBatch::~NnueBatch()
+{
+    freealigned64(entries);
+}
+
+bool NnueBatch::add(chessposition* pos)
+{
+    if (size >= capacity)
+        return false;
+    NnueCurrentArch->BatchTransform(pos, entries + size++ * entrysize);
+    return true;
+}
+
+void NnueBatch::evaluate(int* evals, int first, int num)
+{
+    NnueCurrentArch->BatchPropagate(entries + first * entrysize, num, evals);
+}
+
+
 //
 // FeatureTransformer
 //
@@ -1277,68 +1705,129 @@ static bool testLeb128(NnueNetsource* nr)
 }
 
 
+// Decode the LEB128 values in[0..len) to out; returns the number of decoded values or -1 for a value that exceeds len or maxcount
 template <typename IntType>
-bool readLeb128(NnueNetsource* nr, IntType *out, size_t count)
+static int64_t decodeLeb128(const uint8_t* in, size_t len, IntType* out, size_t maxcount)
 {
-    const uint32_t BUF_SIZE = 4096;
-    uint8_t buf[BUF_SIZE];
-    uint32_t bytes_left = 0;
-    bool okay = nr->read((unsigned char*)&bytes_left, sizeof(uint32_t));
-
-    uint32_t buf_pos = BUF_SIZE;
-    for (size_t i = 0; i < count; ++i)
+    size_t i = 0;
+    size_t pos = 0;
+    while (pos < len)
     {
+        if (i == maxcount)
+            return -1;
+        if (!(in[pos] & 0x80))
+        {
+            // most weights are small and fit into one byte
+            int8_t b = (int8_t)(in[pos++] << 1);
+            out[i++] = (IntType)(b >> 1);
+            continue;
+        }
         IntType result = 0;
         size_t shift = 0;
+        uint8_t nextbyte;
         do
         {
-            if (buf_pos == BUF_SIZE)
-            {
-                okay = okay && nr->read((unsigned char*)buf, min(bytes_left, BUF_SIZE));
-                buf_pos = 0;
-            }
-
-            uint8_t nextbyte = buf[buf_pos++];
-            bytes_left--;
+            if (pos == len || shift >= sizeof(IntType) * 8)
+                return -1;
+            nextbyte = in[pos++];
             result |= (nextbyte & 0x7f) << shift;
             shift += 7;
-
-            if ((nextbyte & 0x80) == 0)
-            {
-                out[i] = (sizeof(IntType) * 8 <= shift || (nextbyte & 0x40) == 0) ? result : result | ~((1 << shift) - 1);
-                break;
-            }
-        } while (shift < sizeof(IntType) * 8);
+        } while (nextbyte & 0x80);
+        out[i++] = (sizeof(IntType) * 8 <= shift || (nextbyte & 0x40) == 0) ? result : result | ~((1 << shift) - 1);
     }
+    return (int64_t)i;
+}
+
+
+// Every value ends with a byte without continuation bit. The compressed block is split into ranges of whole values,
+// a first parallel pass counts the values of each range to get the output index of its first value and a second
+// parallel pass decodes the ranges.
+constexpr int Leb128MaxThreads = 16;
+constexpr size_t Leb128MinBytesPerThread = 1 << 20;
 
-    return okay && (bytes_left == 0);
+template <typename IntType>
+bool readLeb128(NnueNetsource* nr, IntType *out, size_t count)
+{
+    uint32_t bytes = 0;
+    if (!nr->read((unsigned char*)&bytes, sizeof(uint32_t)) || (size_t)(nr->next - nr->readbuffer) + bytes > nr->readbuffersize)
+        return false;
+
+    const uint8_t* in = nr->next;
+    nr->next += bytes;
+
+    int numthreads = (int)min((size_t)min(Leb128MaxThreads, max(1, (int)thread::hardware_concurrency())), bytes / Leb128MinBytesPerThread + 1);
+    nr->leb128threads = max(nr->leb128threads, numthreads);
+    if (numthreads == 1)
+        return decodeLeb128(in, bytes, out, count) == (int64_t)count;
+
+    size_t start[Leb128MaxThreads + 1];
+    size_t first[Leb128MaxThreads + 1];
+    int64_t decoded[Leb128MaxThreads];
+    start[0] = 0;
+    start[numthreads] = bytes;
+    for (int t = 1; t < numthreads; t++)
+    {
+        size_t s = max(start[t - 1], (size_t)bytes * t / numthreads);
+        while (s > 0 && s < bytes && (in[s - 1] & 0x80))
+            s++;
+        start[t] = s;
+    }
+
+    auto countValues = [&](int t) {
+        size_t n = 0;
+        for (size_t i = start[t]; i < start[t + 1]; i++)
+            n += !(in[i] & 0x80);
+        first[t + 1] = n;
+    };
+    auto decodeValues = [&](int t) {
+        decoded[t] = (first[t] > count ? -1 : decodeLeb128(in + start[t], start[t + 1] - start[t], out + first[t], count - first[t]));
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < numthreads; t++)
+        threads.push_back(thread(countValues, t));
+    countValues(0);
+    for (auto& th : threads)
+        th.join();
+    threads.clear();
+
+    first[0] = 0;
+    for (int t = 0; t < numthreads; t++)
+        first[t + 1] += first[t];
+    if (first[numthreads] != count)
+        return false;
+
+    for (int t = 1; t < numthreads; t++)
+        threads.push_back(thread(decodeValues, t));
+    decodeValues(0);
+    for (auto& th : threads)
+        th.join();
+
+    for (int t = 0; t < numthreads; t++)
+        if (decoded[t] != (int64_t)(first[t + 1] - first[t]))
+            return false;
+
+    return true;
 }
 
 
-template <int ftdims, int inputdims, int psqtbuckets>
-bool NnueFeatureTransformer<ftdims, inputdims, psqtbuckets>::ReadFeatureWeights(NnueNetsource* nr, bool bpz)
+template <int ftdims, int inputdims, int psqtbuckets, typename ftweight_t>
+bool NnueFeatureTransformer<ftdims, inputdims, psqtbuckets, ftweight_t>::ReadFeatureWeights(NnueNetsource* nr, bool bpz)
 {
     int i;
     bool okay = true;
 
-    int16_t* src_16 = (int16_t*)calloc(inputdims * ftdims, sizeof(int16_t));
-    int32_t* src_32 = (int32_t*)calloc(inputdims * psqtbuckets, sizeof(int32_t));
-    if (!src_16 || !src_32)
-        return false;
-
     // read bias
     bool isLeb128 = testLeb128(nr);
     if (isLeb128)
-        okay = okay && readLeb128(nr, src_16, ftdims);
+        okay = okay && readLeb128(nr, bias, ftdims);
     else
-        okay = okay && nr->read((unsigned char*)src_16, ftdims * sizeof(int16_t));
-
-    memcpy(bias, src_16, ftdims * sizeof(int16_t));
+        okay = okay && nr->read((unsigned char*)bias, ftdims * sizeof(int16_t));
 
     // read weights
     isLeb128 = testLeb128(nr);
     if (isLeb128) {
-        okay = okay && readLeb128(nr, src_16, inputdims * ftdims);
+        okay = okay && readLeb128(nr, weight, (size_t)inputdims * ftdims);
     }
     else {
         // Handle bpz
@@ -1347,24 +1836,18 @@ bool NnueFeatureTransformer<ftdims, inputdims, psqtbuckets>::ReadFeatureWeights(
         for (i = 0; i < inputdims; i++) {
             if (bpz && i % (10 * 64) == 0)
                 okay = okay && nr->read((unsigned char*)dummyweight, ftdims * sizeof(int16_t));
-            okay = okay && nr->read((unsigned char*)(src_16 + weightsRead), ftdims * sizeof(int16_t));
+            okay = okay && nr->read((unsigned char*)(weight + weightsRead), ftdims * sizeof(ftweight_t));
             weightsRead += ftdims;
         }
     }
-    
-    memcpy(weight, src_16, inputdims * ftdims * sizeof(int16_t));
 
     // read psqt weights
     isLeb128 = testLeb128(nr);
     if (isLeb128)
-        okay = okay && readLeb128(nr, src_32, inputdims * psqtbuckets);
+        okay = okay && readLeb128(nr, psqtWeights, (size_t)inputdims * psqtbuckets);
     else
-        okay = okay && nr->read((unsigned char*)src_32, inputdims * psqtbuckets * sizeof(int32_t));
+        okay = okay && nr->read((unsigned char*)psqtWeights, inputdims * psqtbuckets * sizeof(int32_t));
 
-    memcpy(psqtWeights, src_32, inputdims * psqtbuckets * sizeof(int32_t));
-
-    free(src_16);
-    free(src_32);
     return okay;
 }
 
@@ -1410,8 +1893,8 @@ bool writeLeb128(NnueNetsource* nr, IntType* in, size_t count)
 }
 
 
-template <int ftdims, int inputdims, int psqtbuckets>
-void NnueFeatureTransformer<ftdims, inputdims, psqtbuckets>::WriteFeatureWeights(NnueNetsource* nr, bool leb128)
+template <int ftdims, int inputdims, int psqtbuckets, typename ftweight_t>
+void NnueFeatureTransformer<ftdims, inputdims, psqtbuckets, ftweight_t>::WriteFeatureWeights(NnueNetsource* nr, bool leb128)
 {
     if (leb128) {
         writeLeb128(nr, bias, ftdims);
@@ -1420,9 +1903,44 @@ void NnueFeatureTransformer<ftdims, inputdims, psqtbuckets>::WriteFeatureWeights
     }
     else {
         nr->write((unsigned char*)bias, ftdims * sizeof(int16_t));
-        nr->write((unsigned char*)weight, inputdims * ftdims * sizeof(int16_t));
+        nr->write((unsigned char*)weight, inputdims * ftdims * sizeof(ftweight_t));
+        nr->write((unsigned char*)psqtWeights, inputdims * psqtbuckets * sizeof(int32_t));
+    }
+}
+
+
+// Write the feature transformer with 8bit weights for the compact V5 variant
+// Weights outside of the int8 range are clamped; returns the number of clamped weights
+template <int ftdims, int inputdims, int psqtbuckets, typename ftweight_t>
+size_t NnueFeatureTransformer<ftdims, inputdims, psqtbuckets, ftweight_t>::WriteFeatureWeightsInt8(NnueNetsource* nr, bool leb128)
+{
+    const size_t count = (size_t)inputdims * ftdims;
+    int8_t* weight8 = (int8_t*)allocalign64(count);
+    size_t clamped = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int w = weight[i];
+        if (w < INT8_MIN || w > INT8_MAX)
+        {
+            w = max(INT8_MIN, min(INT8_MAX, w));
+            clamped++;
+        }
+        weight8[i] = (int8_t)w;
+    }
+
+    if (leb128) {
+        writeLeb128(nr, bias, ftdims);
+        writeLeb128(nr, weight8, count);
+        writeLeb128(nr, psqtWeights, inputdims * psqtbuckets);
+    }
+    else {
+        nr->write((unsigned char*)bias, ftdims * sizeof(int16_t));
+        nr->write((unsigned char*)weight8, count * sizeof(int8_t));
         nr->write((unsigned char*)psqtWeights, inputdims * psqtbuckets * sizeof(int32_t));
     }
+    freealigned64(weight8);
+
+    return clamped;
 }
 
 
@@ -2038,24 +2556,202 @@ void NnueInit()
     NnueCurrentArch = nullptr;
 }
 
+void NnueFreeArch(NnueArchitecture* arch)
+{
+    if (arch) {
+        arch->FreeWeights();
+        freealigned64(arch);
+    }
+}
+
 void NnueRemove()
 {
-    if (NnueCurrentArch) {
-        freealigned64(NnueCurrentArch);
-        NnueCurrentArch = nullptr;
+    NnueFreeArch(NnueCurrentArch);
+    NnueCurrentArch = nullptr;
+}
+
+// Make a loaded network the current one. Must be called between searches.
+// The accumulators of the threads are reused if the new network has the same accumulator sizes,
+// otherwise only they are reallocated. The other thread data like history tables is kept.
+void NnueSwap(NnueArchitecture* arch, NnueType nt)
+{
+    NnueArchitecture* oldarch = NnueCurrentArch;
+    bool reuse = (oldarch
+        && oldarch->GetAccumulationSize() == arch->GetAccumulationSize()
+        && oldarch->GetPsqtAccumulationSize() == arch->GetPsqtAccumulationSize());
+
+    if (!reuse)
+        en.freeAccumulators();
+    NnueCurrentArch = arch;
+    NnueReady = nt;
+    if (!reuse)
+        en.allocAccumulators();
+
+    // accumulator caches start with the bias of the network; reset them before the next search
+    en.prepared = false;
+    nnuecache.clean();
+
+    NnueFreeArch(oldarch);
+}
+
+bool NnueArchitecture::AllocWeights()
+{
+    size_t size = GetWeightsSize();
+    weights = (unsigned char*)allocalign64(size);
+    if (!weights)
+        return false;
+    memset(weights, 0, size);
+    SetWeights(weights);
+    return true;
+}
+
+void NnueArchitecture::FreeWeights()
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    if (mappedsize)
+    {
+        munmap(weights - NNUESHAREDHEADERSIZE, mappedsize);
+        mappedsize = 0;
+        weights = nullptr;
+        return;
     }
+#endif
+    if (weights)
+        freealigned64(weights);
+    weights = nullptr;
 }
 
-bool NnueReadNet(NnueNetsource* nr)
+template <class A> static NnueArchitecture* NnueCreateArch()
 {
-    NnueType oldnt = NnueReady;
-    unsigned int oldaccumulationsize = (NnueCurrentArch ? NnueCurrentArch->GetAccumulationSize() : 0);
-    unsigned int oldpsqtaccumulationsize = (NnueCurrentArch ? NnueCurrentArch->GetPsqtAccumulationSize() : 0);
+    char* buffer = (char*)allocalign64(sizeof(A));
+    return new(buffer) A;
+}
 
-    NnueReady = NnueDisabled;
+template <typename ftweight_t> static NnueArchitecture* NnueCreateArchV5(unsigned int ftdims)
+{
+    switch (ftdims) {
+    case 512:
+        return NnueCreateArch<NnueArchitectureV5<512, ftweight_t>>();
+    case 768:
+        return NnueCreateArch<NnueArchitectureV5<768, ftweight_t>>();
+    case 1024:
+        return NnueCreateArch<NnueArchitectureV5<1024, ftweight_t>>();
+    case 1536:
+        return NnueCreateArch<NnueArchitectureV5<1536, ftweight_t>>();
+    case 2048:
+        return NnueCreateArch<NnueArchitectureV5<2048, ftweight_t>>();
+    case 2560:
+        return NnueCreateArch<NnueArchitectureV5<2560, ftweight_t>>();
+    default:
+        return nullptr;
+    }
+}
 
-    NnueRemove();
+// Create the V5 architecture with 16bit or (compact variant) 8bit feature weights
+static NnueArchitecture* NnueCreateArchV5(unsigned int ftdims, bool int8ft)
+{
+    return (int8ft ? NnueCreateArchV5<int8_t>(ftdims) : NnueCreateArchV5<int16_t>(ftdims));
+}
+
+// Get the feature transformer dimension of an uncompressed V5 network from the size after the architecture string
+template <typename ftweight_t> static unsigned int NnueV5DimsFromFilesize(size_t filesize)
+{
+    switch (filesize) {
+    case NnueArchitectureV5<512, ftweight_t>::networkfilesize:
+        return 512;
+    case NnueArchitectureV5<768, ftweight_t>::networkfilesize:
+        return 768;
+    case NnueArchitectureV5<1024, ftweight_t>::networkfilesize:
+        return 1024;
+    case NnueArchitectureV5<1536, ftweight_t>::networkfilesize:
+        return 1536;
+    default:
+        return 0;
+    }
+}
+
+// Map a network in the shared format created by 'export <file> shared'
+// The weights are used in place, so all processes using the file share the same physical memory
+static bool NnueMapNet(NnueNetsource* nr, string filename)
+{
+    nnuesharedheader h;
+    ifstream f(filename, ios::binary);
+    if (!f.read((char*)&h, sizeof(h)) || h.magic != NNUESHAREDMAGIC)
+        return false;
+
+    NnueType nt = NnueArchV5;
+    if (h.version == NNUEFILEVERSIONNOBPZ && h.ftdims == NnueArchitectureV1::NnueFtOutputdims) {
+        nt = NnueArchV1;
+        nr->arch = NnueCreateArch<NnueArchitectureV1>();
+    }
+    else if (h.version == NNUEFILEVERSIONSFNNv5_1024 || h.version == NNUEFILEVERSIONSFNNv5_I8) {
+        nr->arch = NnueCreateArchV5(h.ftdims, h.version == NNUEFILEVERSIONSFNNv5_I8);
+        if (!nr->arch)
+            return false;
+    }
+    else {
+        return false;
+    }
 
+    if (h.filehash != (nr->arch->GetFtHash() ^ nr->arch->GetHash())
+        || h.weightssize != nr->arch->GetWeightsSize())
+    {
+        NnueFreeArch(nr->arch);
+        nr->arch = nullptr;
+        return false;
+    }
+
+    if (h.layouthash != nr->arch->GetLayoutHash())
+    {
+        guiCom << "info string The shared network " + filename + " was created by a build with different weight layout.\n";
+        NnueFreeArch(nr->arch);
+        nr->arch = nullptr;
+        return false;
+    }
+
+    size_t filesize = NNUESHAREDHEADERSIZE + h.weightssize;
+    f.seekg(0, ios::end);
+    if ((size_t)f.tellg() < filesize)
+    {
+        NnueFreeArch(nr->arch);
+        nr->arch = nullptr;
+        return false;
+    }
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    f.close();
+    int fd = open(filename.c_str(), O_RDONLY);
+    void* m = (fd < 0 ? MAP_FAILED : mmap(NULL, filesize, PROT_READ, MAP_SHARED, fd, 0));
+    if (fd >= 0)
+        close(fd);
+    if (m == MAP_FAILED)
+    {
+        guiCom << "info string Cannot map network file " + filename + ".\n";
+        NnueFreeArch(nr->arch);
+        nr->arch = nullptr;
+        return false;
+    }
+    nr->arch->weights = (unsigned char*)m + NNUESHAREDHEADERSIZE;
+    nr->arch->mappedsize = filesize;
+    nr->arch->SetWeights(nr->arch->weights);
+#else
+    // No mapping on this platform; the weights are at least read without decoding and shuffling
+    f.seekg(NNUESHAREDHEADERSIZE);
+    if (!nr->arch->AllocWeights() || !f.read((char*)nr->arch->weights, h.weightssize))
+    {
+        NnueFreeArch(nr->arch);
+        nr->arch = nullptr;
+        return false;
+    }
+#endif
+
+    nr->nt = nt;
+
+    return true;
+}
+
+bool NnueReadNet(NnueNetsource* nr)
+{
     uint32_t version, hash, fthash, nethash, filehash, size;
     string sarchitecture;
 
@@ -2072,108 +2768,87 @@ bool NnueReadNet(NnueNetsource* nr)
 
     NnueType nt;
     bool bpz;
-    int leb128dim = 0;
+    bool int8ft = false;
+    unsigned int ftdims;
+    unsigned int leb128dim = 0;
     char* buffer;
     switch (version) {
     case NNUEFILEVERSIONROTATE:
         bpz = true;
         nt = NnueArchV1;
         buffer = (char*)allocalign64(sizeof(NnueArchitectureV1));
-        NnueCurrentArch = new(buffer) NnueArchitectureV1;
+        nr->arch = new(buffer) NnueArchitectureV1;
         break;
     case NNUEFILEVERSIONNOBPZ:
         bpz = false;
         nt = NnueArchV1;
         buffer = (char*)allocalign64(sizeof(NnueArchitectureV1));
-        NnueCurrentArch = new(buffer) NnueArchitectureV1;
+        nr->arch = new(buffer) NnueArchitectureV1;
         break;
     case NNUEFILEVERSIONSFNNv5_512:
     case NNUEFILEVERSIONSFNNv5_768:
     case NNUEFILEVERSIONSFNNv5_1024:
+    case NNUEFILEVERSIONSFNNv5_I8:
         nt = NnueArchV5;
         bpz = false;
-        switch (remainingfilesize) {
-        case NnueArchitectureV5<512>::networkfilesize:
-            buffer = (char*)allocalign64(sizeof(NnueArchitectureV5<512>));
-            NnueCurrentArch = new(buffer) NnueArchitectureV5<512>;
-            break;
-        case NnueArchitectureV5<768>::networkfilesize:
-            buffer = (char*)allocalign64(sizeof(NnueArchitectureV5<768>));
-            NnueCurrentArch = new(buffer) NnueArchitectureV5<768>;
-            break;
-        case NnueArchitectureV5<1024>::networkfilesize:
-            buffer = (char*)allocalign64(sizeof(NnueArchitectureV5<1024>));
-            NnueCurrentArch = new(buffer) NnueArchitectureV5<1024>;
-            break;
-        case NnueArchitectureV5<1536>::networkfilesize:
-            buffer = (char*)allocalign64(sizeof(NnueArchitectureV5<1536>));
-            NnueCurrentArch = new(buffer) NnueArchitectureV5<1536>;
-            break;
-        default:
+        int8ft = (version == NNUEFILEVERSIONSFNNv5_I8);
+        ftdims = (int8ft ? NnueV5DimsFromFilesize<int8_t>(remainingfilesize) : NnueV5DimsFromFilesize<int16_t>(remainingfilesize));
+        if (!ftdims)
             // We have a leb128 compressed feature transformer and don't know the input dimension yet but at least 1024
-            buffer = (char*)allocalign64(sizeof(NnueArchitectureV5<1024>));
-            NnueCurrentArch = new(buffer) NnueArchitectureV5<1024>;
-            leb128dim = 1024;
-            break;
-        }
+            ftdims = leb128dim = 1024;
+        nr->arch = NnueCreateArchV5(ftdims, int8ft);
         break;
     default:
         return false;
     }
 
     while (1) {
-        fthash = NnueCurrentArch->GetFtHash();
-        nethash = NnueCurrentArch->GetHash();
+        fthash = nr->arch->GetFtHash();
+        nethash = nr->arch->GetHash();
         filehash = (fthash ^ nethash);
 
         if (hash == filehash)
             break;
 
-        NnueRemove();
+        NnueFreeArch(nr->arch);
+        nr->arch = nullptr;
 
         // Try the next dimension for leb128 compressed feature transformer
         switch (leb128dim) {
         case 1024:
-            buffer = (char*)allocalign64(sizeof(NnueArchitectureV5<1536>));
-            NnueCurrentArch = new(buffer) NnueArchitectureV5<1536>;
-            leb128dim = 1536; // next dimensions to test
+            leb128dim = 1536;
             break;
         case 1536:
-            buffer = (char*)allocalign64(sizeof(NnueArchitectureV5<2048>));
-            NnueCurrentArch = new(buffer) NnueArchitectureV5<2048>;
-            leb128dim = 2048; // next dimensions to test
+            leb128dim = 2048;
             break;
         case 2048:
-            buffer = (char*)allocalign64(sizeof(NnueArchitectureV5<2560>));
-            NnueCurrentArch = new(buffer) NnueArchitectureV5<2560>;
-            leb128dim = 0; // no more dimensions to test
+            leb128dim = 2560;
             break;
         default:
             return false;
         }
+        nr->arch = NnueCreateArchV5(leb128dim, int8ft);
     }
 
+    if (!nr->arch->AllocWeights())
+        return false;
+
     // Read the weights of the feature transformer
     if (!nr->read((unsigned char*)&hash, sizeof(uint32_t)) || hash != fthash)
         return false;
-    if (!NnueCurrentArch->ReadFeatureWeights(nr, bpz))
+    if (!nr->arch->ReadFeatureWeights(nr, bpz))
         return false;
+    nr->featuretime = getTime();
 
     // Read the weights of the network layers recursively
-    if (!NnueCurrentArch->ReadWeights(nr, nethash))
+    if (!nr->arch->ReadWeights(nr, nethash))
         return false;
+    nr->layertime = getTime();
 
     if (!nr->endOfNet())
         return false;
 
-    NnueReady = nt;
-
-    if (oldnt != NnueReady
-        || oldaccumulationsize != NnueCurrentArch->GetAccumulationSize()
-        || oldpsqtaccumulationsize != NnueCurrentArch->GetPsqtAccumulationSize())
-    {
-        en.allocThreads();
-    }
+    nr->nt = nt;
 
     return true;
 }
@@ -2235,6 +2910,8 @@ void NnueWriteNet(vector<string> args)
     bool zExport = false;
     bool leb128 = false;
     bool sort = false;
+    bool shared = false;
+    bool int8ft = false;
     if (ci < cs)
         NnueNetPath = args[ci++];
 
@@ -2258,6 +2935,34 @@ void NnueWriteNet(vector<string> args)
             sort = true;
             ci++;
         }
+        else if (args[ci] == "shared")
+        {
+            shared = true;
+            ci++;
+        }
+        else if (args[ci] == "i8")
+        {
+            int8ft = true;
+            ci++;
+        }
+    }
+
+    if (NnueCurrentArch->mappedsize && (sort || rescale))
+    {
+        cout << "Cannot modify the weights of a mapped shared network.\n";
+        return;
+    }
+
+    if (int8ft && NnueCurrentArch->GetFileVersion() != NNUEFILEVERSIONSFNNv5_1024)
+    {
+        cout << "Only V5 networks with 16bit feature weights can be converted to 8bit feature weights.\n";
+        return;
+    }
+
+    if (int8ft && shared)
+    {
+        cout << "Convert to 8bit feature weights first and export the shared network from the converted one.\n";
+        return;
     }
 
     if (sort)
@@ -2284,8 +2989,26 @@ void NnueWriteNet(vector<string> args)
     uint32_t nethash = NnueCurrentArch->GetHash();
     uint32_t filehash = (fthash ^ nethash);
 
-    uint32_t version = NnueCurrentArch->GetFileVersion();
-    string sarchitecture = NnueCurrentArch->GetArchDescription();
+    uint32_t version = (int8ft ? NNUEFILEVERSIONSFNNv5_I8 : NnueCurrentArch->GetFileVersion());
+
+    if (shared) {
+        // Write the weights as they are in memory; the file can only be used by builds with the same weight layout
+        char header[NNUESHAREDHEADERSIZE] = { 0 };
+        nnuesharedheader* h = (nnuesharedheader*)header;
+        h->magic = NNUESHAREDMAGIC;
+        h->version = version;
+        h->ftdims = NnueCurrentArch->GetAccumulationSize();
+        h->filehash = filehash;
+        h->layouthash = NnueCurrentArch->GetLayoutHash();
+        h->weightssize = NnueCurrentArch->GetWeightsSize();
+        os.write(header, NNUESHAREDHEADERSIZE);
+        os.write((char*)NnueCurrentArch->weights, h->weightssize);
+        os.close();
+        cout << "Shared network written to file " << NnueNetPath << "\n";
+        return;
+    }
+
+    string sarchitecture = NnueCurrentArch->GetArchDescription() + (int8ft ? ", int8 feature weights" : "");
     uint32_t size = (uint32_t)sarchitecture.size();
 
     NnueNetsource nr;
@@ -2299,7 +3022,16 @@ void NnueWriteNet(vector<string> args)
     nr.write((unsigned char*)&sarchitecture[0], size);
     nr.write((unsigned char*)&fthash, sizeof(uint32_t));
 
-    NnueCurrentArch->WriteFeatureWeights(&nr, leb128);
+    if (int8ft) {
+        size_t clamped = NnueCurrentArch->WriteFeatureWeightsInt8(&nr, leb128);
+        if (clamped)
+            cout << "Warning: " << clamped << " feature weights are outside of the 8bit range and were clamped.\n";
+        else
+            cout << "All feature weights fit into 8 bit. The converted network evaluates exactly like the original one.\n";
+    }
+    else {
+        NnueCurrentArch->WriteFeatureWeights(&nr, leb128);
+    }
     NnueCurrentArch->WriteWeights(&nr, nethash);
 
     size_t insize = nr.next - nr.readbuffer;
@@ -2331,9 +3063,11 @@ bool NnueNetsource::open()
     bool openOk = false;
     vector<string> filenames;
     unsigned char* inbuffer = nullptr;
-    unsigned char* sourcebuffer = nullptr;
     readbuffer = nullptr;
-    string NnueNetPath = en.GetNnueNetPath();
+    ownbuffer = false;
+    string NnueNetPath = (netpath != "" ? netpath : en.GetNnueNetPath());
+    U64 starttime = getTime();
+    U64 readtime, inflatetime;
 
 #if USE_ZLIB
     int ret;
@@ -2366,6 +3100,19 @@ bool NnueNetsource::open()
         if (!is)
             continue;
 
+        uint32_t magic = 0;
+        if (is.read((char*)&magic, sizeof(uint32_t)) && magic == NNUESHAREDMAGIC) {
+            is.close();
+            openOk = NnueMapNet(this, filenames[i]);
+            if (!openOk)
+                guiCom << "info string The shared network " + NnueNetPath + " cannot be used with this build.\n";
+            else
+                guiCom << "info string Mapping network " + NnueNetPath + " successful. Using NNUE (" + arch->GetArchName() + ", shared).\n";
+            return openOk;
+        }
+        is.clear();
+        is.seekg(0);
+
         struct stat stat_buf;
         if (stat(filenames[i].c_str(), &stat_buf) != 0) {
             guiCom << "info string Cannot get size of network file.\n";
@@ -2392,33 +3139,41 @@ bool NnueNetsource::open()
     }
 #endif // NNUEINCLUDED
 
-    sourcebuffer = inbuffer;
+    // The network is read directly from the file buffer, the inflated buffer or the embedded data without copying
+    readbuffer = inbuffer;
+    readtime = getTime();
 
 #if USE_ZLIB
     // Now test if the input is compressed
     ret = xFlate(false, inbuffer, &inflatebuffer, insize, &inflatesize);
     if (ret == Z_OK) {
-        sourcebuffer = inflatebuffer;
+        readbuffer = inflatebuffer;
         insize = inflatesize;
     }
 #endif // USE_ZLIB
+    inflatetime = getTime();
 
-    // Finally locate buffer for the NnueNetsource object, copy the network data and free the temporary buffers
-    readbuffer = (unsigned char*)allocalign64(insize);
-    if (!readbuffer) {
-        guiCom << "info string Cannot alloc read buffer for network file.\n";
-        goto cleanup;
-    }
-    memcpy(readbuffer, sourcebuffer, insize);
     readbuffersize = insize;
     next = readbuffer;
 
     openOk = NnueReadNet(this);
 
-    if (!openOk)
-        guiCom << "info string The network " + en.GetNnueNetPath() + " seems corrupted or format is not supported.\n";
-    else
-        guiCom << "info string Reading network " + en.GetNnueNetPath() + " successful. Using NNUE (" + NnueCurrentArch->GetArchName() + ").\n";
+    if (!openOk) {
+        guiCom << "info string The network " + NnueNetPath + " seems corrupted or format is not supported.\n";
+    }
+    else {
+        guiCom << "info string Reading network " + NnueNetPath + " successful. Using NNUE (" + arch->GetArchName() + ").\n";
+        char str[256];
+        snprintf(str, 256, "info string Network load time: %.1f ms  (read %.1f ms  inflate %.1f ms  feature transformer %.1f ms%s  layers %.1f ms  setup %.1f ms)\n",
+            (getTime() - starttime) * 1000.0 / en.frequency,
+            (readtime - starttime) * 1000.0 / en.frequency,
+            (inflatetime - readtime) * 1000.0 / en.frequency,
+            (featuretime - inflatetime) * 1000.0 / en.frequency,
+            (leb128threads ? (" with " + to_string(leb128threads) + " LEB128 thread" + (leb128threads > 1 ? "s" : "")).c_str() : ""),
+            (layertime - featuretime) * 1000.0 / en.frequency,
+            (getTime() - layertime) * 1000.0 / en.frequency);
+        guiCom << str;
+    }
 
 cleanup:
 #ifndef NNUEINCLUDED
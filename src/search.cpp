@@ -238,7 +238,8 @@ int chessposition::getQuiescence(int alpha, int beta, int depth)
     STATISTICSDO(if (depth < statistics.qs_mindepth) statistics.qs_mindepth = depth);
 
     bool tpHit;
-    ttentry* tte = tp.probeHash(hash, &tpHit);
+    ttentry ttsnapshot;
+    ttentry* tte = tp.probeHash(hash, &tpHit, &ttsnapshot);
     int hashscore = tpHit ? FIXMATESCOREPROBE(tte->value, ply) : NOSCORE;
     uint16_t hashmovecode = tpHit ? tte->movecode : 0;
 
@@ -329,6 +330,9 @@ int chessposition::getQuiescence(int alpha, int beta, int depth)
             if (score >= beta)
             {
                 STATISTICSINC(qs_moves_fh);
+                STATISTICSINC(ms_cutoff_n[ms->PvNode][0]);
+                STATISTICSADD(ms_cutoff_index[ms->PvNode][0], legalMoves);
+                STATISTICSDO(if (legalMoves == 1) statistics.ms_cutoff_first[ms->PvNode][0]++);
                 tp.addHash(tte, hash, score, staticeval, HASHBETA, 0, (uint16_t)bestcode);
                 return score;
             }
@@ -452,7 +456,8 @@ int chessposition::alphabeta(int alpha, int beta, int depth, bool cutnode)
 
     // TT lookup
     bool tpHit;
-    ttentry* tte = tp.probeHash(newhash, &tpHit);
+    ttentry ttsnapshot;
+    ttentry* tte = tp.probeHash(newhash, &tpHit, &ttsnapshot);
     int hashscore = tpHit ? FIXMATESCOREPROBE(tte->value, ply) : NOSCORE;
     uint16_t hashmovecode = tpHit ? tte->movecode : 0;
     int rawstaticeval = tpHit ? tte->staticeval : NOSCORE;
@@ -940,6 +945,9 @@ int chessposition::alphabeta(int alpha, int beta, int depth, bool cutnode)
                     failhighcount[ply] += (!hashmovecode + 1);
 
                     STATISTICSINC(moves_fail_high);
+                    STATISTICSINC(ms_cutoff_n[PVNode][ms->depth]);
+                    STATISTICSADD(ms_cutoff_index[PVNode][ms->depth], legalMoves);
+                    STATISTICSDO(if (legalMoves == 1) statistics.ms_cutoff_first[PVNode][ms->depth]++);
 
                     if (!excludeMove)
                     {
@@ -1029,7 +1037,8 @@ int chessposition::rootsearch(int alpha, int beta, int depth, int inWindowLast,
 
     bool tpHit;
     int newDepth;
-    ttentry* tte = tp.probeHash(hash, &tpHit);
+    ttentry ttsnapshot;
+    ttentry* tte = tp.probeHash(hash, &tpHit, &ttsnapshot);
     int score = tpHit ? tte->value : NOSCORE;
     uint16_t hashmovecode = tpHit ? tte->movecode : 0;
     int staticeval = tpHit ? tte->staticeval : NOSCORE;
@@ -1078,6 +1087,13 @@ int chessposition::rootsearch(int alpha, int beta, int depth, int inWindowLast,
                 m->value = (m->code & BADSEEFLAG ? -1 : 1) * (mvv[GETCAPTURE(m->code) >> 1] | lva[GETPIECE(m->code) >> 1]);
             else
                 m->value = history[state & S2MMASK][threatSquare][GETFROM(m->code)][GETCORRECTTO(m->code)];
+            // helper threads try moves that raised alpha in any thread right after the PV move(s)
+            if (threadindex && m->value < PVVAL)
+            {
+                unsigned int alpharaises = en.rootmovestats[(uint16_t)m->code].alpharaises.load(memory_order_relaxed);
+                if (alpharaises)
+                    m->value = PVVAL - 0x20000 + min(alpharaises, 0xffffu);
+            }
             if (isMultiPV) {
                 if (multipvtable[0][0] == m->code)
                     m->value = PVVAL;
@@ -1167,11 +1183,16 @@ int chessposition::rootsearch(int alpha, int beta, int depth, int inWindowLast,
         unplayMove<false>(m->code);
 
         nodespermove[(uint16_t)m->code] += nodes - nodesbeforemove;
+        if (en.Threads > 1)
+            en.rootmovestats[(uint16_t)m->code].nodes.fetch_add(nodes - nodesbeforemove, memory_order_relaxed);
 
         if (en.stopLevel == ENGINESTOPIMMEDIATELY)
             // time is over; immediate stop requested
             return bestscore;
 
+        if (en.Threads > 1 && score > alpha)
+            en.rootmovestats[(uint16_t)m->code].alpharaises.fetch_add(1, memory_order_relaxed);
+
         if (!ISTACTICAL(m->code))
             quietMoves[0][quietsPlayed++] = m->code;
         else
@@ -1329,6 +1350,52 @@ static void uciScore(searchthread *thr, int inWindow, U64 thinktime, int score,
 }
 
 
+// Select the thread that reports the best move by a vote of all threads
+// The vote for a move is weighted by the completed depth and the score margin to the worst thread
+static searchthread* voteBestThread()
+{
+    searchthread* bestthr = &en.sthread[0];
+    int minscore = SCOREWHITEWINS;
+    for (int i = 0; i < en.Threads; i++)
+    {
+        searchthread* hthr = &en.sthread[i];
+        if (hthr->pos.bestmove && hthr->lastCompleteDepth)
+            minscore = min(minscore, hthr->pos.bestmovescore[0]);
+    }
+
+    map<uint32_t, S64> votes;
+    for (int i = 0; i < en.Threads; i++)
+    {
+        searchthread* hthr = &en.sthread[i];
+        if (hthr->pos.bestmove && hthr->lastCompleteDepth)
+            votes[hthr->pos.bestmove] += (S64)(hthr->pos.bestmovescore[0] - minscore + 14) * hthr->lastCompleteDepth;
+    }
+
+    for (int i = 1; i < en.Threads; i++)
+    {
+        searchthread* hthr = &en.sthread[i];
+        if (!hthr->pos.bestmove || !hthr->lastCompleteDepth)
+            continue;
+        int hscore = hthr->pos.bestmovescore[0];
+        int bestscore = bestthr->pos.bestmovescore[0];
+        if (bestthr->pos.bestmove && bestthr->lastCompleteDepth && bestscore >= SCORETBWININMAXPLY)
+        {
+            // proven win; prefer the fastest one
+            if (hscore > bestscore)
+                bestthr = hthr;
+        }
+        else if (hscore >= SCORETBWININMAXPLY
+            || votes[hthr->pos.bestmove] > votes[bestthr->pos.bestmove]
+            || (votes[hthr->pos.bestmove] == votes[bestthr->pos.bestmove] && hscore > bestscore))
+        {
+            bestthr = hthr;
+        }
+    }
+
+    return bestthr;
+}
+
+
 template <RootsearchType RT>
 void mainSearch(searchthread *thr)
 {
@@ -1348,6 +1415,11 @@ void mainSearch(searchthread *thr)
 
     chessposition *pos = &thr->pos;
 
+    // bind to the node of the thread or release an earlier binding when the policy was switched off
+    numa.bindThisThread(numa.active() ? numa.nodeOfThread(thr->index) : -1);
+
+    pos->allocBuffers();
+
     thr->lastCompleteDepth = 0;
     thr->depth = 1;
     if (en.maxdepth > 0)
@@ -1477,7 +1549,8 @@ void mainSearch(searchthread *thr)
                 if (!pos->bestmove)
                 {
                     bool tpHit;
-                    ttentry* tte = tp.probeHash(pos->hash, &tpHit);
+                    ttentry ttsnapshot;
+                    ttentry* tte = tp.probeHash(pos->hash, &tpHit, &ttsnapshot);
                     if (tpHit)
                     {
                         pos->bestmove = pos->shortMove2FullMove(tte->movecode);
@@ -1549,7 +1622,18 @@ void mainSearch(searchthread *thr)
             if (en.tmEnabled && (inWindow == 1 || !constantRootMoves))
             {
                 // Recalculate remaining time for next depth
-                int bestmovenodesratio = pos->nodes ? (int)(128 * (2.5 -  2 * (double)pos->nodespermove[(uint16_t)pos->bestmove] / pos->nodes)) : 128;
+                int bestmovenodesratio;
+                if (en.Threads > 1)
+                {
+                    // use the root move statistics of all threads
+                    U64 totalnodes, tbhits;
+                    en.getNodesAndTbhits(&totalnodes, &tbhits);
+                    U64 bestmovenodes = en.rootmovestats[(uint16_t)pos->bestmove].nodes.load(memory_order_relaxed);
+                    bestmovenodesratio = totalnodes ? (int)(128 * (2.5 - 2 * (double)bestmovenodes / totalnodes)) : 128;
+                }
+                else {
+                    bestmovenodesratio = pos->nodes ? (int)(128 * (2.5 -  2 * (double)pos->nodespermove[(uint16_t)pos->bestmove] / pos->nodes)) : 128;
+                }
                 en.resetEndTime(nowtime, constantRootMoves, bestmovenodesratio);
             }
 
@@ -1615,16 +1699,22 @@ void mainSearch(searchthread *thr)
 
         // Output of best move
         searchthread *bestthr = thr;
-        int bestscore = bestthr->pos.bestmovescore[0];
-        for (int i = 1; i < en.Threads; i++)
+        if (en.Threads > 1 && en.threadVoting && !isMultiPV)
         {
-            // search for a better score in the other threads
-            searchthread *hthr = &en.sthread[i];
-            if (hthr->lastCompleteDepth >= bestthr->lastCompleteDepth
-                && hthr->pos.bestmovescore[0] > bestscore)
+            bestthr = voteBestThread();
+        }
+        else {
+            int bestscore = bestthr->pos.bestmovescore[0];
+            for (int i = 1; i < en.Threads; i++)
             {
-                bestscore = hthr->pos.bestmovescore[0];
-                bestthr = hthr;
+                // search for a better score in the other threads
+                searchthread *hthr = &en.sthread[i];
+                if (hthr->lastCompleteDepth >= bestthr->lastCompleteDepth
+                    && hthr->pos.bestmovescore[0] > bestscore)
+                {
+                    bestscore = hthr->pos.bestmovescore[0];
+                    bestthr = hthr;
+                }
             }
         }
         if (pos->bestmove != bestthr->pos.bestmove)
@@ -1682,6 +1772,13 @@ void mainSearch(searchthread *thr)
             strPonder = moveToString(pos->pondermove);
             guiStr += " ponder " + strPonder;
         }
+        if (en.debug)
+        {
+#ifdef TTLOCKFREE
+            guiCom << "info string Transposition table torn reads rejected: " + to_string(tp.tornReads.load()) + "\n";
+#endif
+            tp.printStats();
+        }
         guiCom << guiStr + "\n";
         bool bStoppedImmediately = (en.stopLevel == ENGINESTOPIMMEDIATELY);
         en.stopLevel = ENGINESTOPIMMEDIATELY;
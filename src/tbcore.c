@@ -20,6 +20,8 @@
 #endif
 #include "tbcore.h"
 
+namespace rubichess {
+
 #define TBMAX_PIECE 650
 #define TBMAX_PAWN 861
 
@@ -1380,3 +1382,5 @@ static void free_dtz_entry(struct TBEntry *entry)
 
 static int wdl_to_map[5] = { 1, 3, 0, 2, 0 };
 static uint8_t pa_flags[5] = { 8, 0, 0, 0, 4 };
+
+} // namespace rubichess
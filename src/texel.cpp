@@ -129,6 +129,7 @@ bool PGNtoFEN(int depth)
     pos.tps.count = 0;
     pos.pwnhsh.setSize(1);
     pos.mtrlhsh.init();
+    pos.allocBuffers();
 
     int gamescount = 0;
     fenWritten = 0ULL;
@@ -1427,6 +1428,7 @@ void tuneInit()
 {
     pos.mtrlhsh.init();
     pos.pwnhsh.setSize(0);
+    pos.allocBuffers();
     pos.tps.count = 0;
     pos.resetStats();
     registerallevals(&pos);
@@ -1439,6 +1441,7 @@ void tuneCleanup()
         free(texelpts);
     pos.mtrlhsh.remove();
     pos.pwnhsh.remove();
+    pos.freeBuffers();
 }
 
 } // namespace rubichess
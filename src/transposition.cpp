@@ -19,7 +19,9 @@
 #include "RubiChess.h"
 
 #if defined(__linux__) && !defined(__ANDROID__)
-#include <sys/mman.h> // madvise
+#include <sys/mman.h> // madvise, mmap
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 using namespace rubichess;
@@ -28,7 +30,7 @@ namespace rubichess {
 
 zobrist::zobrist()
 {
-    raninit(&rnd, 0);
+    raninit(&rnd, ZOBRISTSEED);
     int i;
     int j = 0;
     for (i = 0; i < 128 * 16; i++)
@@ -130,22 +132,35 @@ U64 zobrist::getMaterialHash(chessposition *pos)
 }
 
 
-transposition::~transposition()
+template <class L> transpositiontable<L>::~transpositiontable()
 {
     if (size > 0)
-        my_large_free(table);
+        freeTable();
 }
 
-int transposition::setSize(int sizeMb)
+template <class L> void transpositiontable<L>::freeTable()
+{
+#if defined(__linux__) && !defined(__ANDROID__)
+    if (mappedsize)
+    {
+        munmap((char*)table - TTFILEHEADERSIZE, mappedsize);
+        mappedsize = 0;
+        return;
+    }
+#endif
+    my_large_free(table);
+}
+
+template <class L> int transpositiontable<L>::setSize(int sizeMb)
 {
     int restMb = 0;
     int msb = 0;
     if (size > 0)
-        my_large_free(table);
-    size_t clustersize = sizeof(transpositioncluster);
+        freeTable();
+    size_t clustersize = sizeof(cluster_t);
 #ifdef SDEBUG
     // Don't use the debugging part of the cluster for calculation of size to get consistent search with non SDEBUG
-    clustersize = offsetof(transpositioncluster, debugHash);
+    clustersize = offsetof(cluster_t, debugHash);
 #endif
     U64 maxsize = ((U64)sizeMb << 20) / clustersize;
     if (!maxsize)
@@ -156,22 +171,13 @@ int transposition::setSize(int sizeMb)
     GETMSB(msb, maxsize);
     size = (1ULL << msb);
     restMb = (int)(((maxsize ^ size) >> 20) * clustersize);  // return rest for pawnhash
-    size_t allocsize = (size_t)(size * sizeof(transpositioncluster));
-
-#if defined(__linux__) && !defined(__ANDROID__) // Many thanks to Sami Kiminki for advise on the huge page theory and for this patch
-    // Round up hashSize to the next 2M for alignment
-    constexpr size_t HashAlignBytes = 2ull << 20;
-    allocsize = ((allocsize + HashAlignBytes - 1u) / HashAlignBytes) * HashAlignBytes;
-
-    table = (transpositioncluster*)aligned_alloc(HashAlignBytes, allocsize);
+    size_t allocsize = (size_t)(size * sizeof(cluster_t));
 
-    // Linux-specific call to request huge pages, in case the aligned_alloc()
-    // call above doesn't already trigger them (depends on transparent huge page
-    // settings)
-    madvise(table, allocsize, MADV_HUGEPAGE);
-#else
-    table = (transpositioncluster*)my_large_malloc(allocsize);
-#endif
+    // On Linux this uses explicit huge pages if available and falls back to transparent huge pages
+    // Many thanks to Sami Kiminki for advise on the huge page theory
+    table = (cluster_t*)my_large_malloc(allocsize);
+    if (table && numa.active() && numa.policy == NumaInterleave)
+        numa.interleave(table, allocsize);
     if (!table) {
         // alloc failed, back to old size
         size = 0;
@@ -185,47 +191,317 @@ int transposition::setSize(int sizeMb)
     return restMb;
 }
 
-void transposition::clean()
+static void cleanPart(void* start, size_t size, int node)
+{
+    // With NUMA policy the first touch by a pinned thread places the part on its node; without it an earlier binding is released
+    numa.bindThisThread(node);
+    memset(start, 0, size);
+}
+
+template <class L> void transpositiontable<L>::clean()
 {
-    size_t totalsize = size * sizeof(transpositioncluster);
-    size_t sizePerThread = totalsize / en.Threads;
-    thread tthread[MAXTHREADS];
-    for (int i = 0; i < en.Threads; i++)
+    size_t totalsize = size * sizeof(cluster_t);
+    int numThreads = (numa.active() ? max(en.Threads, numa.nodes) : en.Threads);
+    size_t sizePerThread = totalsize / numThreads;
+    if (pool.size() < numThreads)
+        pool.resize(numThreads);
+    for (int i = 0; i < numThreads; i++)
     {
         void *start = (char*)table + i * sizePerThread;
-        tthread[i] = thread(memset, start, 0, sizePerThread);
+        pool.run(i, bind(cleanPart, start, sizePerThread, numa.active() ? numa.nodeOfThread(i) : -1));
     }
-    memset((char*)table + en.Threads * sizePerThread, 0, totalsize - en.Threads * sizePerThread);
-    for (int i = 0; i < en.Threads; i++)
+    memset((char*)table + numThreads * sizePerThread, 0, totalsize - numThreads * sizePerThread);
+    for (int i = 0; i < numThreads; i++)
+        pool.wait(i);
+    numOfSearchShiftTwo = 0;
+    samplekeysvalid = false;
+#ifdef TTLOCKFREE
+    tornReads = 0;
+#endif
+}
+
+
+#ifdef TTLOCKFREE
+// Reads a consistent copy of an entry; returns false if a concurrent write was detected
+template <class L> bool transpositiontable<L>::readEntry(cluster_t* cluster, int i, entry_t* e)
+{
+    U64 payload = cluster->payload[i].load(memory_order_relaxed);
+    upper_t key = cluster->key[i].load(memory_order_relaxed);
+    if (payload != cluster->payload[i].load(memory_order_relaxed))
     {
-        if (tthread[i].joinable())
-            tthread[i].join();
+        tornReads.fetch_add(1, memory_order_relaxed);
+        return false;
     }
-    numOfSearchShiftTwo = 0;
+    e->hashupper = key ^ TTPAYLOADFOLD(upper_t, payload);
+    e->movecode = (uint16_t)payload;
+    e->value = (int16_t)(payload >> 16);
+    e->staticeval = (int16_t)(payload >> 32);
+    e->depth = (uint8_t)(payload >> 48);
+    e->boundAndAge = (uint8_t)(payload >> 56);
+    e->bucket = i;
+    e->cluster = cluster;
+    return true;
+}
+
+
+template <class L> void transpositiontable<L>::writeEntry(entry_t* e)
+{
+    U64 payload = TTPAYLOAD(e);
+    cluster_t* cluster = (cluster_t*)e->cluster;
+    cluster->payload[e->bucket].store(payload, memory_order_relaxed);
+    cluster->key[e->bucket].store(e->hashupper ^ TTPAYLOADFOLD(upper_t, payload), memory_order_relaxed);
+}
+#endif
+
+
+template <class L> void transpositiontable<L>::fillFileHeader(ttfileheader* h)
+{
+    memset(h, 0, sizeof(ttfileheader));
+    h->magic = TTFILEMAGIC;
+    h->bucketnum = L::buckets;
+    h->entrysize = sizeof(entry_t);
+    h->clustersize = sizeof(cluster_t);
+    h->size = size;
+    h->zobristseed = ZOBRISTSEED;
+    h->zobristcheck = zb.boardtable[0] ^ zb.boardtable[64 * 16 - 1] ^ zb.s2m;
+    h->age = numOfSearchShiftTwo;
+}
+
+
+template <class L> bool transpositiontable<L>::saveToFile(string filename)
+{
+#ifdef SDEBUG
+    guiCom << "info string Saving the hash is not supported in SDEBUG mode.\n";
+    return false;
+#endif
+    // Write to a temporary file first; the table may be a mapping of the target file
+    string tmpname = filename + ".tmp";
+    ofstream f(tmpname, ios::binary);
+    if (!f.is_open())
+    {
+        guiCom << "info string Cannot open " + tmpname + " for writing.\n";
+        return false;
+    }
+    char header[TTFILEHEADERSIZE] = { 0 };
+    fillFileHeader((ttfileheader*)header);
+    f.write(header, TTFILEHEADERSIZE);
+    f.write((char*)table, size * sizeof(cluster_t));
+    f.close();
+    if (f.fail() || rename(tmpname.c_str(), filename.c_str()))
+    {
+        remove(tmpname.c_str());
+        guiCom << "info string Cannot write hash to " + filename + ".\n";
+        return false;
+    }
+    guiCom << "info string Hash saved to " + filename + " (" + to_string((size * sizeof(cluster_t)) >> 20) + " MByte).\n";
+    return true;
+}
+
+
+template <class L> bool transpositiontable<L>::loadFromFile(string filename)
+{
+#ifdef SDEBUG
+    guiCom << "info string Loading the hash is not supported in SDEBUG mode.\n";
+    return false;
+#endif
+    ttfileheader expected, h;
+    fillFileHeader(&expected);
+    ifstream f(filename, ios::binary);
+    if (!f.is_open() || !f.read((char*)&h, sizeof(h)))
+    {
+        guiCom << "info string Cannot read hash file " + filename + ".\n";
+        return false;
+    }
+    if (h.magic != expected.magic || h.bucketnum != expected.bucketnum || h.entrysize != expected.entrysize
+        || h.clustersize != expected.clustersize || h.zobristseed != expected.zobristseed || h.zobristcheck != expected.zobristcheck)
+    {
+        guiCom << "info string Hash file " + filename + " has an incompatible format.\n";
+        return false;
+    }
+    if (h.size != size)
+    {
+        guiCom << "info string Hash file " + filename + " needs Hash " + to_string((h.size * h.clustersize) >> 20) + ".\n";
+        return false;
+    }
+    size_t tablesize = size * sizeof(cluster_t);
+    f.seekg(0, ios::end);
+    if ((size_t)f.tellg() < TTFILEHEADERSIZE + tablesize)
+    {
+        guiCom << "info string Hash file " + filename + " is truncated.\n";
+        return false;
+    }
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    // Map the file copy-on-write so the table is usable without reading it first
+    f.close();
+    int fd = open(filename.c_str(), O_RDONLY);
+    size_t mapsize = TTFILEHEADERSIZE + tablesize;
+    void* m = (fd < 0 ? MAP_FAILED : mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0));
+    if (fd >= 0)
+        close(fd);
+    if (m == MAP_FAILED)
+    {
+        guiCom << "info string Cannot map hash file " + filename + ".\n";
+        return false;
+    }
+    freeTable();
+    table = (cluster_t*)((char*)m + TTFILEHEADERSIZE);
+    mappedsize = mapsize;
+#else
+    f.seekg(TTFILEHEADERSIZE);
+    if (!f.read((char*)table, tablesize))
+    {
+        clean();
+        guiCom << "info string Cannot read hash file " + filename + ".\n";
+        return false;
+    }
+#endif
+    numOfSearchShiftTwo = (uint8_t)h.age;
+    samplekeysvalid = false;
+#ifdef TTLOCKFREE
+    tornReads = 0;
+#endif
+    guiCom << "info string Hash loaded from " + filename + ".\n";
+    return true;
 }
 
 
-unsigned int transposition::getUsedinPermill()
+template <class L> typename transpositiontable<L>::cluster_t* transpositiontable<L>::sampleCluster(unsigned int i)
+{
+    // Weyl sequence; spreads the samples over the whole table and visits every cluster once for i < size
+    return &table[(i * 0x9E3779B97F4A7C15ULL) & sizemask];
+}
+
+
+template <class L> bool transpositiontable<L>::sampleEntry(cluster_t* cluster, int i, entry_t* e)
+{
+#ifdef TTLOCKFREE
+    return readEntry(cluster, i, e);
+#else
+    *e = cluster->entry[i];
+    return true;
+#endif
+}
+
+
+template <class L> unsigned int transpositiontable<L>::getUsedinPermill()
 {
     unsigned int used = 0;
+    entry_t e;
 
     // Take 1000 samples
-    for (int i = 0; i < 1000 / TTBUCKETNUM; i++)
-        for (int j = 0; j < TTBUCKETNUM; j++)
-            if ((table[i].entry[j].boundAndAge & AGEMASK) == numOfSearchShiftTwo)
+    for (unsigned int i = 0; i < 1000 / L::buckets; i++)
+    {
+        cluster_t* cluster = sampleCluster(i);
+        for (int j = 0; j < L::buckets; j++)
+            if (sampleEntry(cluster, j, &e) && e.depth && (e.boundAndAge & AGEMASK) == numOfSearchShiftTwo)
                 used++;
+    }
 
     return used;
 }
 
 
-void transposition::addHash(ttentry* entry, U64 hash, int val, int16_t staticeval, int bound, int depth, uint16_t movecode)
+template <class L> void transpositiontable<L>::nextSearch()
+{
+    numOfSearchShiftTwo = (numOfSearchShiftTwo + AGEINC) & AGEMASK;
+
+    // Remember the keys of the sampled entries to measure the replacements during this search
+    entry_t e;
+    samplekeysvalid = (size > 0);
+    for (unsigned int i = 0; samplekeysvalid && i < TTSTATSAMPLES; i++)
+    {
+        cluster_t* cluster = sampleCluster(i);
+        for (int j = 0; j < L::buckets; j++)
+            samplekeys[i * L::buckets + j] = (sampleEntry(cluster, j, &e) && e.depth ? e.hashupper : 0);
+    }
+}
+
+
+template <class L> void transpositiontable<L>::printStats()
+{
+    const int agebins = 5;
+    const int depthbins = 9;
+    U64 samples = 0, used = 0, torn = 0;
+    U64 age[agebins] = { 0 };
+    U64 depth[depthbins] = { 0 };
+    U64 bound[4] = { 0 };
+    U64 prevused = 0, prevempty = 0, replaced = 0, filled = 0;
+    entry_t e;
+
+    if (!size)
+        return;
+
+    unsigned int samplenum = (unsigned int)min((size_t)TTSTATSAMPLES, size);
+    for (unsigned int i = 0; i < samplenum; i++)
+    {
+        cluster_t* cluster = sampleCluster(i);
+        for (int j = 0; j < L::buckets; j++)
+        {
+            samples++;
+            if (!sampleEntry(cluster, j, &e))
+            {
+                torn++;
+                continue;
+            }
+            upper_t prevkey = samplekeys[i * L::buckets + j];
+            if (samplekeysvalid)
+            {
+                if (prevkey)
+                {
+                    prevused++;
+                    replaced += (e.depth && e.hashupper != prevkey);
+                }
+                else {
+                    prevempty++;
+                    filled += (e.depth != 0);
+                }
+            }
+            if (!e.depth)
+                continue;
+            used++;
+            int searchesago = ((AGECYCLE + numOfSearchShiftTwo - e.boundAndAge) & AGEMASK) >> AGESHIFT;
+            age[min(searchesago, agebins - 1)]++;
+            depth[min(FIXDEPTHFROMTT(e.depth) / 4, depthbins - 1)]++;
+            bound[e.boundAndAge & BOUNDMASK]++;
+        }
+    }
+
+    char str[256];
+    auto pct = [](U64 n, U64 total) { return total ? 100.0 * n / total : 0.0; };
+    snprintf(str, 256, "info string TT stats: %lld entries of %lld clusters sampled from %lld clusters; %lld torn\n",
+        (long long)samples, (long long)samplenum, (long long)size, (long long)torn);
+    guiCom << str;
+    snprintf(str, 256, "info string TT used: %.1f%%  current search: %.1f%%\n", pct(used, samples), pct(age[0], samples));
+    guiCom << str;
+    snprintf(str, 256, "info string TT age (searches ago): 0: %.1f%%  1: %.1f%%  2: %.1f%%  3: %.1f%%  4+: %.1f%%\n",
+        pct(age[0], samples), pct(age[1], samples), pct(age[2], samples), pct(age[3], samples), pct(age[4], samples));
+    guiCom << str;
+    string s = "info string TT depth:";
+    for (int i = 0; i < depthbins; i++)
+    {
+        snprintf(str, 256, "  %d%s: %.1f%%", i * 4, (i < depthbins - 1 ? ("-" + to_string(i * 4 + 3)).c_str() : "+"), pct(depth[i], used));
+        s += str;
+    }
+    guiCom << s + "\n";
+    snprintf(str, 256, "info string TT bounds: exact %.1f%%  lower %.1f%%  upper %.1f%%  none %.1f%%\n",
+        pct(bound[HASHEXACT], used), pct(bound[HASHBETA], used), pct(bound[HASHALPHA], used), pct(bound[HASHUNKNOWN], used));
+    guiCom << str;
+    if (samplekeysvalid)
+        snprintf(str, 256, "info string TT last search: replaced %.1f%% of used entries, filled %.1f%% of empty entries\n", pct(replaced, prevused), pct(filled, prevempty));
+    else
+        snprintf(str, 256, "info string TT last search: no replacement data\n");
+    guiCom << str;
+}
+
+
+template <class L> void transpositiontable<L>::addHash(entry_t* entry, U64 hash, int val, int16_t staticeval, int bound, int depth, uint16_t movecode)
 {
 #ifdef EVALTUNE
     // don't use transposition table when tuning evaluation
     return;
 #endif
-    const hashupper_t hashupper = GETHASHUPPER(hash);
+    const upper_t hashupper = getHashUpper(hash);
     const uint8_t ttdepth = depth - TTDEPTH_OFFSET;
 
     // Don't overwrite an entry from the same position, unless we have
@@ -240,25 +516,35 @@ void transposition::addHash(ttentry* entry, U64 hash, int val, int16_t staticeva
         entry->movecode = movecode;
         entry->staticeval = staticeval;
         entry->value = (int16_t)val;
+#ifdef TTLOCKFREE
+        writeEntry(entry);
+#endif
     }
 }
 
 
-void transposition::printHashentry(U64 hash)
+template <class L> void transpositiontable<L>::printHashentry(U64 hash)
 {
     unsigned long long index = hash & sizemask;
-    transpositioncluster *data = &table[index];
+    cluster_t *data = &table[index];
     printf("Hashentry for %llx\n", hash);
-    for (int i = 0; i < TTBUCKETNUM; i++)
+    for (int i = 0; i < L::buckets; i++)
     {
-        if ((data->entry[i].hashupper) == GETHASHUPPER(hash))
+#ifdef TTLOCKFREE
+        entry_t snapshot;
+        entry_t* e = &snapshot;
+        if (readEntry(data, i, e) && e->hashupper == getHashUpper(hash))
+#else
+        entry_t* e = &data->entry[i];
+        if (e->hashupper == getHashUpper(hash))
+#endif
         {
-            printf("Match in upper part: %x / %x\n", (unsigned int)data->entry[i].hashupper, (unsigned int)(hash >> 32));
-            printf("Move code: %x\n", (unsigned int)data->entry[i].movecode);
-            printf("Depth:     %d\n", data->entry[i].depth);
-            printf("Value:     %d\n", data->entry[i].value);
-            printf("Eval:      %d\n", data->entry[i].staticeval);
-            printf("BoundAge:  %d\n", data->entry[i].boundAndAge);
+            printf("Match in upper part: %x / %x\n", (unsigned int)e->hashupper, (unsigned int)(hash >> 32));
+            printf("Move code: %x\n", (unsigned int)e->movecode);
+            printf("Depth:     %d\n", e->depth);
+            printf("Value:     %d\n", e->value);
+            printf("Eval:      %d\n", e->staticeval);
+            printf("BoundAge:  %d\n", e->boundAndAge);
             return;
         }
     }
@@ -266,13 +552,73 @@ void transposition::printHashentry(U64 hash)
 }
 
 
-ttentry* transposition::probeHash(U64 hash, bool* bFound)
+#ifdef TTLOCKFREE
+template <class L> typename transpositiontable<L>::entry_t* transpositiontable<L>::probeHash(U64 hash, bool* bFound, entry_t* snapshot)
+{
+    cluster_t* cluster = &table[hash & sizemask];
+    entry_t entries[L::buckets];
+    entry_t* e;
+    entry_t* tornEntry = nullptr;
+    const upper_t hashupper = getHashUpper(hash);
+
+    for (int i = 0; i < L::buckets; i++)
+    {
+        // First try to find a free or matching entry; a torn entry is never a hit but is replaced first
+        e = &entries[i];
+        if (!readEntry(cluster, i, e))
+        {
+            e->bucket = i;
+            e->cluster = cluster;
+            e->hashupper = (upper_t)~hashupper;
+            e->depth = 0;
+            e->boundAndAge = numOfSearchShiftTwo;
+            if (!tornEntry)
+                tornEntry = e;
+            continue;
+        }
+        if (e->hashupper == hashupper || !e->depth)
+        {
+            *bFound = (bool)e->depth;
+            *snapshot = *e;
+            if (*bFound && (e->boundAndAge & AGEMASK) != numOfSearchShiftTwo)
+            {
+                snapshot->boundAndAge = (e->boundAndAge & BOUNDMASK) | numOfSearchShiftTwo;
+                writeEntry(snapshot);
+            }
+            return snapshot;
+        }
+    }
+
+    *bFound = false;
+    if (tornEntry)
+    {
+        *snapshot = *tornEntry;
+        return snapshot;
+    }
+
+    entry_t* leastValuableEntry = &entries[0];
+
+    for (int i = 1; i < L::buckets; i++)
+    {
+        e = &entries[i];
+        if (e->depth - ((AGECYCLE + numOfSearchShiftTwo - e->boundAndAge) & AGEMASK) * 2
+            < leastValuableEntry->depth - ((AGECYCLE + numOfSearchShiftTwo - leastValuableEntry->boundAndAge) & AGEMASK) * 2)
+        {
+            // found a new less valuable entry
+            leastValuableEntry = e;
+        }
+    }
+    *snapshot = *leastValuableEntry;
+    return snapshot;
+}
+#else
+template <class L> typename transpositiontable<L>::entry_t* transpositiontable<L>::probeHash(U64 hash, bool* bFound, entry_t*)
 {
-    transpositioncluster* cluster = &table[hash & sizemask];
-    ttentry* e;
-    const hashupper_t hashupper = GETHASHUPPER(hash);
+    cluster_t* cluster = &table[hash & sizemask];
+    entry_t* e;
+    const upper_t hashupper = getHashUpper(hash);
 
-    for (int i = 0; i < TTBUCKETNUM; i++)
+    for (int i = 0; i < L::buckets; i++)
     {
         // First try to find a free or matching entry
         e = &(cluster->entry[i]);
@@ -285,9 +631,9 @@ ttentry* transposition::probeHash(U64 hash, bool* bFound)
     }
 
     *bFound = false;
-    ttentry* leastValuableEntry = &(cluster->entry[0]);
+    entry_t* leastValuableEntry = &(cluster->entry[0]);
 
-    for (int i = 1; i < TTBUCKETNUM; i++)
+    for (int i = 1; i < L::buckets; i++)
     {
         e = &(cluster->entry[i]);
         if (e->depth - ((AGECYCLE + numOfSearchShiftTwo - e->boundAndAge) & AGEMASK) * 2
@@ -299,16 +645,23 @@ ttentry* transposition::probeHash(U64 hash, bool* bFound)
     }
     return leastValuableEntry;
 }
+#endif
 
 
-uint16_t transposition::getMoveCode(U64 hash)
+template <class L> uint16_t transpositiontable<L>::getMoveCode(U64 hash)
 {
     unsigned long long index = hash & sizemask;
-    transpositioncluster *data = &table[index];
-    for (int i = 0; i < TTBUCKETNUM; i++)
+    cluster_t *data = &table[index];
+    for (int i = 0; i < L::buckets; i++)
     {
-        if ((data->entry[i].hashupper) == GETHASHUPPER(hash))
+#ifdef TTLOCKFREE
+        entry_t e;
+        if (readEntry(data, i, &e) && e.hashupper == getHashUpper(hash))
+            return e.movecode;
+#else
+        if ((data->entry[i].hashupper) == getHashUpper(hash))
             return data->entry[i].movecode;
+#endif
     }
     return 0;
 }
@@ -325,14 +678,14 @@ void Pawnhash::setSize(int sizeMb)
 
     sizemask = size - 1;
     size_t tablesize = (size_t)size * sizeof(S_PAWNHASHENTRY);
-    table = (S_PAWNHASHENTRY*)allocalign64(tablesize);
+    table = (S_PAWNHASHENTRY*)my_large_malloc(tablesize);
     memset(table, 0, tablesize);
 }
 
 
 void Pawnhash::remove()
 {
-    freealigned64(table);
+    my_large_free(table);
 }
 
 
@@ -383,4 +736,10 @@ bool  Materialhash::probeHash(U64 hash, Materialhashentry **entry)
 
 transposition tp;
 
+// Explicit template instantiation
+// This avoids putting these definitions in header file
+template class transpositiontable<TTLayout3x10>;
+template class transpositiontable<TTLayout6x10>;
+template class transpositiontable<TTLayout5x12>;
+
 } // namespace rubichess
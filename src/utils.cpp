@@ -498,6 +498,30 @@ string chessposition::AlgebraicFromShort(string s)
 }
 
 
+#ifdef LARGEPAGESUPPORT
+// Memory from large pages is released by the platform specific call and the size needed for
+// this is not known to the caller, so these allocations are registered.
+static map<void*, size_t> largepagemappings;
+static mutex largepagemutex;
+
+static void registerLargePages(void* m, size_t s)
+{
+    lock_guard<mutex> lock(largepagemutex);
+    largepagemappings[m] = s;
+}
+
+static size_t unregisterLargePages(void* m)
+{
+    lock_guard<mutex> lock(largepagemutex);
+    map<void*, size_t>::iterator it = largepagemappings.find(m);
+    if (it == largepagemappings.end())
+        return 0;
+    size_t s = it->second;
+    largepagemappings.erase(it);
+    return s;
+}
+#endif
+
 
 #ifdef _WIN32
 #include <process.h>
@@ -572,6 +596,10 @@ void* my_large_malloc(size_t s)
             UseLargePages = -1;
             guiCom << "info string Allocation of memory: Large pages not available for this size. Disabled for now.\n";
         }
+        else
+        {
+            registerLargePages(mem, s);
+        }
     }
     
     if (!mem)
@@ -589,7 +617,7 @@ void my_large_free(void* m)
     if (!m)
         return;
     
-    if (en.allowlargepages && UseLargePages > 0)
+    if (unregisterLargePages(m))
         VirtualFree(m, 0, MEM_RELEASE);
     else
         _aligned_free(m);
@@ -624,6 +652,96 @@ void Sleep(long x)
     nanosleep(&now, NULL);
 }
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sys/mman.h>
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// Explicit huge pages from the hugetlbfs pool (vm.nr_hugepages) with fallback to transparent huge pages
+static size_t reportedPageSize = 0;
+
+static void reportPageSize(size_t pagesize)
+{
+    lock_guard<mutex> lock(largepagemutex);
+    if (pagesize == reportedPageSize)
+        return;
+    reportedPageSize = pagesize;
+    if (pagesize >= (1ULL << 30))
+        guiCom << "info string Allocation of memory uses 1GB huge pages.\n";
+    else if (pagesize >= (2ULL << 20))
+        guiCom << "info string Allocation of memory uses 2MB huge pages.\n";
+    else
+        guiCom << "info string Allocation of memory: Huge pages not available. Using transparent huge pages.\n";
+}
+
+void* my_large_malloc(size_t s)
+{
+    void* mem = nullptr;
+    size_t pagesize = 0;
+
+    // Huge pages from the limited pool only for allocations that fill at least one of them; 1GB pages accordingly
+    if (en.allowlargepages && s >= (2ULL << 20))
+    {
+        const size_t pagesizes[] = { 1ULL << 30, 2ULL << 20 };
+        const int pageflags[] = { MAP_HUGE_1GB, MAP_HUGE_2MB };
+        for (int i = (s >= pagesizes[0] ? 0 : 1); i < 2 && !mem; i++)
+        {
+            size_t len = (s + pagesizes[i] - 1) & ~(pagesizes[i] - 1);
+            void* m = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | pageflags[i], -1, 0);
+            if (m != MAP_FAILED)
+            {
+                mem = m;
+                pagesize = pagesizes[i];
+                registerLargePages(mem, len);
+            }
+        }
+    }
+
+    if (!mem)
+    {
+        if (s >= (2ULL << 20))
+        {
+            // Round up to the next 2M for alignment and request transparent huge pages
+            constexpr size_t HashAlignBytes = 2ULL << 20;
+            mem = aligned_alloc(HashAlignBytes, (s + HashAlignBytes - 1) & ~(HashAlignBytes - 1));
+            if (mem)
+                madvise(mem, s, MADV_HUGEPAGE);
+        }
+        else
+        {
+            mem = allocalign64(s);
+        }
+    }
+
+    if (!mem)
+        cerr << "Cannot allocate memory (" << s << " bytes)\n";
+    else if (en.allowlargepages && (pagesize || s >= (2ULL << 20)))
+        reportPageSize(pagesize);
+
+    return mem;
+}
+
+
+void my_large_free(void* m)
+{
+    if (!m)
+        return;
+
+    size_t len = unregisterLargePages(m);
+    if (len)
+        munmap(m, len);
+    else
+        free(m);
+}
+#endif
+
 #define MYCWD(x,y) getcwd(x,y)
 const char kPathSeparator = '/';
 
@@ -639,12 +757,172 @@ string CurrentWorkingDir()
 }
 
 
+//
+// NUMA support
+//
+numaconfig numa;
+
+#ifdef NUMASUPPORT
+#include <sched.h>
+#include <sys/syscall.h>
+#ifdef USE_NUMA
+#include <numa.h>
+#endif
+
+// Parses a sysfs list like "0-15,32-47"
+static vector<int> parseSysfsList(string filename)
+{
+    vector<int> list;
+    ifstream f(filename);
+    string s;
+    if (!f.is_open() || !getline(f, s))
+        return list;
+    stringstream ss(s);
+    string range;
+    while (getline(ss, range, ','))
+    {
+        size_t dash = range.find('-');
+        try {
+            int first = stoi(range.substr(0, dash));
+            int last = (dash == string::npos ? first : stoi(range.substr(dash + 1)));
+            for (int i = first; i <= last; i++)
+                list.push_back(i);
+        }
+        catch (...) {}
+    }
+    return list;
+}
+
+void numaconfig::init()
+{
+    if (nodes)
+        return;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+        return;
+
+#ifdef USE_NUMA
+    uselibnuma = (numa_available() >= 0);
+#endif
+
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &allowed))
+            allowedcpus.push_back(c);
+
+    vector<int> online = parseSysfsList("/sys/devices/system/node/online");
+    for (int n : online)
+    {
+        vector<int> cpus;
+        for (int c : parseSysfsList("/sys/devices/system/node/node" + to_string(n) + "/cpulist"))
+            if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+                cpus.push_back(c);
+        if (cpus.size())
+        {
+            nodeid.push_back(n);
+            nodecpus.push_back(cpus);
+        }
+    }
+
+    if (nodecpus.empty())
+    {
+        // no topology in sysfs; treat the machine as a single node
+        nodeid.push_back(0);
+        nodecpus.push_back(allowedcpus);
+    }
+    nodes = (int)nodecpus.size();
+}
+
+static thread_local bool threadBound = false;
+
+void numaconfig::bindThisThread(int node)
+{
+    if (node < 0)
+    {
+        unbindThisThread();
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int c : nodecpus[node])
+        CPU_SET(c, &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+#ifdef USE_NUMA
+    if (uselibnuma)
+        numa_set_preferred(nodeid[node]);
+#endif
+    threadBound = true;
+}
+
+// Give the thread all cpus of the process and local memory allocation back
+void numaconfig::unbindThisThread()
+{
+    if (!threadBound)
+        return;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int c : allowedcpus)
+        CPU_SET(c, &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+#ifdef USE_NUMA
+    if (uselibnuma)
+        numa_set_localalloc();
+#endif
+    threadBound = false;
+}
+
+void numaconfig::interleave(void* p, size_t size)
+{
+    if (nodes < 2)
+        return;
+#ifdef USE_NUMA
+    if (uselibnuma)
+    {
+        numa_interleave_memory(p, size, numa_all_nodes_ptr);
+        return;
+    }
+#endif
+    // MPOL_INTERLEAVE via the raw syscall if libnuma is not available
+    const int mpolInterleave = 3;
+    unsigned long mask[16] = { 0 };
+    for (int n : nodeid)
+        if (n < 16 * 64)
+            mask[n / 64] |= (1UL << (n % 64));
+    syscall(SYS_mbind, p, size, mpolInterleave, mask, 16 * 64, 0);
+}
+
+#else
+
+void numaconfig::init() {}
+void numaconfig::bindThisThread(int) {}
+void numaconfig::unbindThisThread() {}
+void numaconfig::interleave(void*, size_t) {}
+
+#endif
+
+void numaconfig::setPolicy(string p)
+{
+    policy = (p == "Bind" ? NumaBind : p == "Interleave" ? NumaInterleave : NumaOff);
+    if (policy == NumaOff)
+        return;
+    init();
+    if (!nodes)
+    {
+        guiCom << "info string Cannot read the NUMA topology. Policy " + p + " disabled.\n";
+        policy = NumaOff;
+        return;
+    }
+    guiCom << "info string NUMA policy " + p + " using " + to_string(nodes) + " node(s)" + (uselibnuma ? " (libnuma)" : "") + ".\n";
+}
+
+
 #ifdef STATISTICS
 #define NODBZ(x) (double)(max(1ULL, x))
 void statistic::output(vector<string> args)
 {
 
-    U64 n, i1, i2, i3, i4, i5, i6, i7, i8, i9, i10, i11;;
+    U64 n, i1, i2, i3, i4, i5, i6, i7, i8, i9, i10, i11, i12, i13, i14;;
     double f0, f1, f2, f3, f4, f5, f6, f7, f10, f11;
     char str[512];
 
@@ -755,6 +1033,45 @@ void statistic::output(vector<string> args)
         nnue_accupdate_cache, f0, nnue_accupdate_inc, f1, nnue_accupdate_full, f2, nnue_accupdate_spec, f3);
     guiCom << str;
 
+    // accumulator updates avoided by lazy mode and skipped plies per node
+    n = ab_n + qs_n[0] + qs_n[1];
+    f0 = 100.0 * nnue_accupdate_back / NODBZ(nnue_accupdate_inc);
+    f1 = nnue_accupdate_lazy / NODBZ(n);
+    f2 = nnue_accupdate_skip / NODBZ(n);
+    f3 = (nnue_accupdate_lazy + nnue_accupdate_skip) / NODBZ(n);
+    snprintf(str, 512, "[STATS] AccuAvoid:  Backward: %10lld (%7.4f%%)   Lazy/node: %7.4f   Skipped/node: %7.4f   Avoided/node: %7.4f\n",
+        nnue_accupdate_back, f0, f1, f2, f3);
+    guiCom << str;
+
+    // changed features per full update
+    f0 = nnue_refresh_features / NODBZ(nnue_accupdate_full);
+    snprintf(str, 512, "[STATS] AccuRefresh:  Full: %10lld   Features/full update: %7.4f\n", nnue_accupdate_full, f0);
+    guiCom << str;
+
+    // evaluation cache
+    f0 = 100.0 * nnue_evalcache_hit / NODBZ(nnue_evalcache_probe);
+    snprintf(str, 512, "[STATS] EvalCache:    Probes: %10lld   Hits: %10lld (%7.4f%%)\n", nnue_evalcache_probe, nnue_evalcache_hit, f0);
+    guiCom << str;
+
+    // static exchange evaluation
+    n = ab_n + qs_n[0] + qs_n[1];
+    f0 = see_n / NODBZ(n);
+    f1 = 100.0 * see_trivial / NODBZ(see_n);
+    f2 = see_attackers / NODBZ(n);
+    snprintf(str, 512, "[STATS] SEE:   Calls: %12lld   Calls/node: %7.4f   %%Trivial: %5.2f   Attackersets/node: %7.4f\n", see_n, f0, f1, f2);
+    guiCom << str;
+#ifdef SEECACHE
+    f0 = (see_attackers - see_cachehit) / NODBZ(n);
+    f1 = 100.0 * see_cachehit / NODBZ(see_attackers);
+    snprintf(str, 512, "[STATS] SEECache:   Hits: %10lld (%7.4f%%)   Computed attackersets/node: %7.4f\n", see_cachehit, f1, f0);
+    guiCom << str;
+#endif
+
+#ifdef TTLOCKFREE
+    snprintf(str, 512, "[STATS] TT torn reads: %12lld\n", (U64)tp.tornReads.load());
+    guiCom << str;
+#endif
+
     int p, d, l;
     // effective branching factor
     f0 = 0;
@@ -774,7 +1091,7 @@ void statistic::output(vector<string> args)
     // Move selector
     for (p = 0; p < 2; p++)
     {
-        n = i1 = i2 = i3 = i4 = i5 = i6 = i7 = i8 = i9 = i10 = i11 = 0ULL;
+        n = i1 = i2 = i3 = i4 = i5 = i6 = i7 = i8 = i9 = i10 = i11 = i12 = i13 = i14 = 0ULL;
         guiCom << "[STATS] Statistics of move selector " + (p ? string("PV node") : string("non-PV node")) + "\n";
         for (d = 0; d < MAXSTATDEPTH; d++) {
             n += ms_n[p][d];
@@ -783,13 +1100,14 @@ void statistic::output(vector<string> args)
             if (ms_n[p][d] == 0)
                 continue;
             string depthStr = (d == 0 ? "QSearch " : d == MAXSTATDEPTH - 1 ? "ProbCut " : "Depth#" + (d < 10 ? string(" ") : "") + to_string(d));
-            snprintf(str, 512, "n=%12lld   (%6.2f%%)  %%TctStg:%5.1f Mvs:%4.1f  %%SpcStg:%5.1f Mvs:%4.1f  %%QteStg:%5.1f Mvs:%4.1f  %%BdTStg:%5.1f Mvs:%4.1f  %%EvsStg:%5.1f Mvs:%4.1f\n",
+            snprintf(str, 512, "n=%12lld   (%6.2f%%)  %%TctStg:%5.1f Mvs:%4.1f  %%SpcStg:%5.1f Mvs:%4.1f  %%QteStg:%5.1f Mvs:%4.1f  %%BdTStg:%5.1f Mvs:%4.1f  %%EvsStg:%5.1f Mvs:%4.1f  Cuts:%12lld Idx:%5.2f 1st:%5.1f%%\n",
                 ms_n[p][d], 100.0 * ms_n[p][d] / NODBZ(n),
                 100.0 * ms_tactic_stage[p][d][0] / NODBZ(ms_n[p][d]), ms_tactic_moves[p][d][0] / NODBZ(ms_tactic_stage[p][d][0]),
                 100.0 * ms_spcl_stage[p][d] / NODBZ(ms_n[p][d]), ms_spcl_moves[p][d] / NODBZ(ms_spcl_stage[p][d]),
                 100.0 * ms_quiet_stage[p][d][0] / NODBZ(ms_n[p][d]), ms_quiet_moves[p][d][0] / NODBZ(ms_quiet_stage[p][d][0]),
                 100.0 * ms_badtactic_stage[p][d] / NODBZ(ms_n[p][d]), ms_badtactic_moves[p][d] / NODBZ(ms_badtactic_stage[p][d]),
-                100.0 * ms_evasion_stage[p][d][0] / NODBZ(ms_n[p][d]), ms_evasion_moves[p][d][0] / NODBZ(ms_evasion_stage[p][d][0]));
+                100.0 * ms_evasion_stage[p][d][0] / NODBZ(ms_n[p][d]), ms_evasion_moves[p][d][0] / NODBZ(ms_evasion_stage[p][d][0]),
+                ms_cutoff_n[p][d], ms_cutoff_index[p][d] / NODBZ(ms_cutoff_n[p][d]), 100.0 * ms_cutoff_first[p][d] / NODBZ(ms_cutoff_n[p][d]));
             guiCom << "[STATS] " + depthStr + "  " + str;
             i1 += ms_n[p][d];
             i2 += ms_tactic_stage[p][d][0];
@@ -802,14 +1120,18 @@ void statistic::output(vector<string> args)
             i9 += ms_badtactic_moves[p][d];
             i10 += ms_evasion_stage[p][d][0];
             i11 += ms_evasion_moves[p][d][0];
+            i12 += ms_cutoff_n[p][d];
+            i13 += ms_cutoff_index[p][d];
+            i14 += ms_cutoff_first[p][d];
         }
-        snprintf(str, 512, "n=%12lld   (%6.2f%%)  %%TctStg:%5.1f Mvs:%4.1f  %%SpcStg:%5.1f Mvs:%4.1f  %%QteStg:%5.1f Mvs:%4.1f  %%BdTStg:%5.1f Mvs:%4.1f  %%EvsStg:%5.1f Mvs:%4.1f\n",
+        snprintf(str, 512, "n=%12lld   (%6.2f%%)  %%TctStg:%5.1f Mvs:%4.1f  %%SpcStg:%5.1f Mvs:%4.1f  %%QteStg:%5.1f Mvs:%4.1f  %%BdTStg:%5.1f Mvs:%4.1f  %%EvsStg:%5.1f Mvs:%4.1f  Cuts:%12lld Idx:%5.2f 1st:%5.1f%%\n",
             i1, 100.0 * i1 / NODBZ(n),
             100.0 * i2 / NODBZ(n), i3 / NODBZ(i2),
             100.0 * i4 / NODBZ(n), i5 / NODBZ(i4),
             100.0 * i6 / NODBZ(n), i7 / NODBZ(i6),
             100.0 * i8 / NODBZ(n), i9 / NODBZ(i8),
-            100.0 * i10 / NODBZ(n), i11 / NODBZ(i10));
+            100.0 * i10 / NODBZ(n), i11 / NODBZ(i10),
+            i12, i13 / NODBZ(i12), 100.0 * i14 / NODBZ(i12));
         guiCom << string("[STATS] Total:    ") + str;
 
         guiCom << "[STATS]  Quiets per movelist lenth\n";